@@ -5,26 +5,83 @@
 //  Created by zhanwang-sky on 2025/3/31.
 //
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 #include "av-tools/capi/av_streamer.h"
+#include "av-tools/ffmpeg/avio.hpp"
 #include "av-tools/ffmpeg/ffmpeg_helper.hpp"
+#include "av-tools/ffmpeg/frame_pool.hpp"
+#include "av-tools/ffmpeg/frame_queue.hpp"
+#include "av-tools/ffmpeg/packet_queue.hpp"
 #include "av-tools/utils/rtmp_streamer.hpp"
+#include "av-tools/utils/spsc_ring.hpp"
+#include "av-tools/utils/stats.hpp"
+#include "av-tools/utils/streamer_pool.hpp"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
 
 using namespace av::ffmpeg;
 using namespace av::utils;
 
+struct StreamerStats {
+  static void fill(av_streamer_stage_stats_t* dst, const LatencyHistogram& hist) {
+    dst->count = hist.count();
+    dst->total_ns = hist.total_ns();
+    dst->max_ns = hist.max_ns();
+    dst->p50_ns = hist.percentile_ns(50.0);
+    dst->p99_ns = hist.percentile_ns(99.0);
+  }
+
+  LatencyHistogram resample;
+  LatencyHistogram frame;
+  LatencyHistogram encode;
+  LatencyHistogram video_encode;
+  LatencyHistogram mux;
+  LatencyHistogram net;
+  std::atomic<uint64_t> in_samples{0};
+  std::atomic<uint64_t> out_packets{0};
+  std::atomic<uint64_t> out_bytes{0};
+  std::atomic<uint64_t> net_writes{0};
+  std::atomic<uint64_t> net_bytes{0};
+};
+
+template <typename T>
+void interleave_samples(const uint8_t* const* planes, int nb_channels, int offset, int nb_samples, uint8_t* dst) {
+  T* out = reinterpret_cast<T*>(dst);
+  for (int i = offset; i != offset + nb_samples; ++i) {
+    for (int c = 0; c != nb_channels; ++c) {
+      *out++ = reinterpret_cast<const T*>(planes[c])[i];
+    }
+  }
+}
+
+struct av_streamer_pool : public StreamerPool {
+  using StreamerPool::StreamerPool;
+};
+
 struct AVIOHelper {
-  AVIOHelper(const char* url)
-      : streamer_(url)
+  AVIOHelper(const char* url, StreamerStats& stats, int io_buffer_size = 32768)
+      : streamer_(url),
+        stats_(stats)
   {
     uint8_t* io_buf = (uint8_t*) av_malloc(io_buffer_size);
     if (!io_buf) {
       goto err_exit;
     }
 
-    avio_ = avio_alloc_context(io_buf, io_buffer_size, 1, &streamer_,
+    avio_ = avio_alloc_context(io_buf, io_buffer_size, 1, this,
                                nullptr, url_write, nullptr);
     if (!avio_) {
       goto err_exit;
@@ -44,150 +101,1195 @@ struct AVIOHelper {
 
   inline bool connect() { return streamer_.connect(); }
 
+  // fails the current and every later write
+  void abort() {
+    aborted_.store(true, std::memory_order_release);
+    streamer_.interrupt();
+  }
+
   inline AVIOContext* ctx() { return avio_; }
 
   static int url_write(void* opaque, const uint8_t *buf, int size) {
-    auto p_streamer = static_cast<RTMPStreamer*>(opaque);
-    int ret = p_streamer->write(buf, size);
-    if (!ret) {
-      return AVERROR_EOF;
+    return static_cast<AVIOHelper*>(opaque)->write(buf, size);
+  }
+
+  // RTMP_Write() needs every tag header (and the FLV header) at the start
+  // of a write, so only whole tags are passed on and the tail is kept.
+  int write(const uint8_t* buf, int size) {
+    if (aborted_.load(std::memory_order_acquire)) {
+      return AVERROR_EXIT;
+    }
+
+    const uint8_t* data = buf;
+    size_t len = size;
+
+    if (!pending_.empty()) {
+      pending_.insert(pending_.end(), buf, buf + size);
+      data = pending_.data();
+      len = pending_.size();
+    }
+
+    size_t n = complete_tags(data, len);
+    if (n > 0) {
+      ScopedLatency latency(stats_.net);
+      if (streamer_.write(data, static_cast<int>(n)) <= 0) {
+        return AVERROR(EIO);
+      }
+      stats_.net_writes.fetch_add(1, std::memory_order_relaxed);
+      stats_.net_bytes.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    if (data == buf) {
+      pending_.assign(buf + n, buf + len);
+    } else {
+      pending_.erase(pending_.begin(), pending_.begin() + n);
     }
-    return ret;
+
+    return size;
+  }
+
+  size_t complete_tags(const uint8_t* data, size_t len) {
+    static constexpr size_t flv_header_size = 9 + 4;
+    static constexpr size_t tag_header_size = 11;
+    size_t pos = need_flv_header_ ? flv_header_size : 0;
+    size_t end = 0;
+
+    while (pos + tag_header_size <= len) {
+      size_t data_size = (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3];
+      size_t tag_size = tag_header_size + data_size + 4;
+      if (pos + tag_size > len) {
+        break;
+      }
+      pos += tag_size;
+      end = pos;
+    }
+
+    if (end) {
+      need_flv_header_ = false;
+    }
+
+    return end;
   }
 
-  static constexpr int io_buffer_size = 32768;
   RTMPStreamer streamer_;
+  StreamerStats& stats_;
   AVIOContext* avio_ = nullptr;
+  std::vector<uint8_t> pending_;
+  bool need_flv_header_ = true;
+  std::atomic<bool> aborted_{false};
+};
+
+struct StreamOutput {
+  StreamOutput(const char* url, const char* format,
+               const std::vector<AVCodecContext*>& tracks,
+               const av_streamer_opts_t& opts,
+               int queue_size,
+               StreamerStats& stats,
+               av_streamer_chunk_fn sink = nullptr)
+      : stats_(stats),
+        sink_(std::move(sink)),
+        pkt_(av_packet_alloc(), &pkt_deleter)
+  {
+    if (!pkt_) {
+      throw std::runtime_error("StreamOutput: Cannot allocate memory");
+    }
+
+    // rw_timeout bounds how long a stalled peer can hold a write
+    DictHelper tcp_opts;
+    if ((av_dict_set(&tcp_opts.get(), "tcp_timeout", "2500000", 0) < 0) ||
+        (av_dict_set(&tcp_opts.get(), "rw_timeout", "5000000", 0) < 0) ||
+        (av_dict_set(&tcp_opts.get(), "tcp_nodelay", "1", 0) < 0)) {
+      throw std::runtime_error("StreamOutput: error setting tcp opts");
+    }
+
+    if (sink_) {
+      if (!format || (strcmp(format, "flv") && strcmp(format, "mp4"))) {
+        throw std::invalid_argument("StreamOutput: invalid chunk format");
+      }
+      fragmented_ = !strcmp(format, "mp4");
+      writer_ = std::make_unique<AVIOWriter>();
+      muxer_.set_avio(writer_->ctx());
+    } else if (!url) {
+      throw std::invalid_argument("StreamOutput: invalid url");
+    }
+
+    bool is_rtmp = url && !strncmp(url, "rtmp", 4);
+    if (!format && is_rtmp) {
+      format = "flv";
+    }
+
+    // setup muxer
+    muxer_.set_interrupt_callback(AVIOInterruptCB{&StreamOutput::interrupt_cb, this});
+    if (is_rtmp && opts.output == AV_STREAMER_OUTPUT_LIBRTMP) {
+      int io_buffer_size = opts.io_buffer_size > 0 ? opts.io_buffer_size : (opts.low_latency ? 4096 : 32768);
+      avio_helper_ = std::make_unique<AVIOHelper>(url, stats_, io_buffer_size);
+      if (!avio_helper_->connect()) {
+        throw std::runtime_error("StreamOutput: error connecting rtmp");
+      }
+      muxer_.set_avio(avio_helper_->ctx());
+    }
+    if (muxer_.open(url, format, nullptr, &tcp_opts.get()) < 0) {
+      throw std::runtime_error("StreamOutput: error opening muxer");
+    }
+    if (avio_helper_ || opts.low_latency) {
+      muxer_.ctx()->flush_packets = 1;
+    }
+    if (opts.low_latency) {
+      muxer_.ctx()->max_interleave_delta = low_latency_interleave_us;
+    }
+
+    // setup streams, one per track
+    for (AVCodecContext* enc_ctx : tracks) {
+      AVStream* st = muxer_.new_stream();
+      if (!st) {
+        throw std::runtime_error("StreamOutput: error creating stream");
+      }
+      if (avcodec_parameters_from_context(st->codecpar, enc_ctx) < 0) {
+        throw std::runtime_error("StreamOutput: error copying codecpar");
+      }
+      st->time_base = enc_ctx->time_base;
+      track_tbs_.push_back(enc_ctx->time_base);
+      is_video_.push_back(enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO);
+    }
+    has_video_ = std::find(is_video_.begin(), is_video_.end(), true) != is_video_.end();
+
+    // fragmented mp4 for MSE: moov without samples, then one moof/mdat per flush
+    DictHelper header_opts;
+    if (fragmented_ &&
+        (av_dict_set(&header_opts.get(), "movflags", "empty_moov+default_base_moof+frag_custom", 0) < 0)) {
+      throw std::runtime_error("StreamOutput: error setting movflags");
+    }
+    if (muxer_.write_header(&header_opts.get()) < 0) {
+      throw std::runtime_error("StreamOutput: error writing header");
+    }
+    if (writer_) {
+      emit(AV_STREAMER_CHUNK_HEADER);
+    }
+
+    // start writer thread, or write on the shared I/O pool
+    queue_ = std::make_unique<PacketQueue>(queue_size, to_policy(opts.drop_policy));
+    if (tracks.size() > 1) {
+      // joining a running session, start video at a keyframe
+      queue_->skip_until_keyframe(tracks.size());
+    }
+    if (opts.io_pool) {
+      strand_.emplace(opts.io_pool->make_strand());
+    } else {
+      worker_ = std::thread(&StreamOutput::write_loop, this);
+    }
+  }
+
+  // drains the queue into the muxer and emits the last fragment, unless
+  // abort() was called
+  ~StreamOutput() {
+    queue_->close();
+    if (strand_) {
+      schedule_drain();
+      std::unique_lock<std::mutex> lk(tasks_mtx_);
+      tasks_cv_.wait(lk, [this] { return !tasks_; });
+    } else {
+      worker_.join();
+    }
+    if (frag_open_ && !failed_.load(std::memory_order_acquire) &&
+        !aborted_.load(std::memory_order_acquire)) {
+      flush_fragment();
+    }
+  }
+
+  // pkt is in track time base, returns false if the output has failed
+  bool send(const AVPacket* pkt) {
+    if (failed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    if (!queue_->push(pkt)) {
+      return false;
+    }
+    if (strand_) {
+      schedule_drain();
+    }
+    return true;
+  }
+
+  // Drops the queued packets and fails the write in progress, so a removed
+  // output whose peer hangs does not hold up whoever releases it.
+  void abort() {
+    aborted_.store(true, std::memory_order_release);
+    queue_->abort();
+    if (avio_helper_) {
+      avio_helper_->abort();
+    }
+  }
+
+  inline uint64_t dropped() const { return queue_->dropped(); }
+
+  inline uint64_t queued() const { return queue_->size(); }
+
+  static int interrupt_cb(void* opaque) {
+    return static_cast<StreamOutput*>(opaque)->aborted_.load(std::memory_order_acquire);
+  }
+
+  static PacketQueue::Policy to_policy(int drop_policy) {
+    switch (drop_policy) {
+      case AV_STREAMER_QUEUE_DROP_OLDEST:
+        return PacketQueue::Policy::drop_oldest;
+      case AV_STREAMER_QUEUE_BLOCK:
+        return PacketQueue::Policy::block;
+      default:
+        return PacketQueue::Policy::drop_until_keyframe;
+    }
+  }
+
+  bool write(AVPacket* pkt) {
+    if (writer_) {
+      return write_chunk(pkt);
+    }
+
+    AVStream* st = muxer_.ctx()->streams[pkt->stream_index];
+    av_packet_rescale_ts(pkt, track_tbs_[pkt->stream_index], st->time_base);
+    ScopedLatency latency(stats_.mux);
+    int rc = muxer_.interleaved_write_frame(pkt);
+    av_packet_unref(pkt);
+    return rc >= 0;
+  }
+
+  // flv: one chunk per packet. mp4: one chunk per fragment, cut before each
+  // video keyframe or once it spans frag_duration_us, so MSE gets a few
+  // appends per second instead of one per frame. Either way a chunk never
+  // splits a tag or a fragment, and viewers can join at any key chunk.
+  // Packets arrive in encode order, which is close enough to interleaved for
+  // a live feed.
+  bool write_chunk(AVPacket* pkt) {
+    int idx = pkt->stream_index;
+    bool key = (pkt->flags & AV_PKT_FLAG_KEY) && (is_video_[idx] || !has_video_);
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (ts != AV_NOPTS_VALUE) {
+      ts = av_rescale_q(ts, track_tbs_[idx], av_make_q(1, AV_TIME_BASE));
+    }
+    AVStream* st = muxer_.ctx()->streams[idx];
+    av_packet_rescale_ts(pkt, track_tbs_[idx], st->time_base);
+
+    ScopedLatency latency(stats_.mux);
+    if (fragmented_) {
+      bool cut = frag_open_ &&
+                 ((is_video_[idx] && key) ||
+                  (ts != AV_NOPTS_VALUE && frag_start_ != AV_NOPTS_VALUE &&
+                   ts - frag_start_ >= frag_duration_us));
+      if (cut && !flush_fragment()) {
+        av_packet_unref(pkt);
+        return false;
+      }
+      if (!frag_open_) {
+        frag_open_ = true;
+        frag_flags_ = key ? AV_STREAMER_CHUNK_KEY : 0;
+        frag_start_ = ts;
+      }
+    }
+
+    int rc = muxer_.write_frame(pkt);
+    av_packet_unref(pkt);
+    if (rc < 0) {
+      return false;
+    }
+
+    if (!fragmented_) {
+      emit(key ? AV_STREAMER_CHUNK_KEY : 0);
+    }
+    return true;
+  }
+
+  // frag_custom: closes the open fragment and emits it
+  bool flush_fragment() {
+    frag_open_ = false;
+    if (muxer_.write_frame(nullptr) < 0) {
+      return false;
+    }
+    emit(frag_flags_);
+    return true;
+  }
+
+  void emit(int flags) {
+    auto chunk = writer_->take();
+    if (chunk) {
+      sink_(std::move(chunk), flags);
+    }
+  }
+
+  void write_loop() {
+    while (queue_->pop(pkt_.get())) {
+      if (!write(pkt_.get())) {
+        failed_.store(true, std::memory_order_release);
+        queue_->close();
+        return;
+      }
+    }
+  }
+
+  // at most one drain is queued on the strand, later packets are picked up by it
+  void schedule_drain() {
+    if (drain_pending_.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(tasks_mtx_);
+      ++tasks_;
+    }
+    boost::asio::post(*strand_, [this] { pool_drain(); });
+  }
+
+  // writes what is queued, never waits for more
+  void pool_drain() {
+    drain_pending_.store(false, std::memory_order_release);
+
+    while (!failed_.load(std::memory_order_acquire) && queue_->try_pop(pkt_.get())) {
+      if (!write(pkt_.get())) {
+        failed_.store(true, std::memory_order_release);
+        queue_->close();
+      }
+    }
+
+    std::lock_guard<std::mutex> lk(tasks_mtx_);
+    if (!--tasks_) {
+      tasks_cv_.notify_all();
+    }
+  }
+
+  // the muxer holds a packet back at most this long waiting for the other track
+  static constexpr int64_t low_latency_interleave_us = 50000;
+
+  // longest mp4 chunk fragment that does not end at a video keyframe
+  static constexpr int64_t frag_duration_us = 100000;
+
+  StreamerStats& stats_;
+  av_streamer_chunk_fn sink_;
+  std::vector<AVRational> track_tbs_;
+  std::vector<bool> is_video_;
+  bool has_video_ = false;
+  bool fragmented_ = false;
+  bool frag_open_ = false;  // mp4 chunk outputs: packets written since the last flush
+  int frag_flags_ = 0;
+  int64_t frag_start_ = AV_NOPTS_VALUE;  // in AV_TIME_BASE
+  std::unique_ptr<AVIOHelper> avio_helper_;
+  std::unique_ptr<AVIOWriter> writer_;  // chunked outputs, outlives the muxer's trailer
+  Muxer muxer_;
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt_;
+  std::unique_ptr<PacketQueue> queue_;
+  std::thread worker_;
+  std::optional<StreamerPool::strand_type> strand_;  // io_pool outputs
+  std::atomic<bool> drain_pending_{false};
+  std::mutex tasks_mtx_;
+  std::condition_variable tasks_cv_;
+  int tasks_ = 0;
+  std::atomic<bool> failed_{false};
+  std::atomic<bool> aborted_{false};
 };
 
 struct av_streamer {
  public:
-  av_streamer(int sample_rate, int nb_channels, const char* url,
+  using OutputList = std::vector<std::pair<int, std::shared_ptr<StreamOutput>>>;
+
+  av_streamer(const av_streamer_opts_t& opts,
               int ar = 16000,
               int ac = 1,
               enum AVCodecID acodec = AV_CODEC_ID_AAC,
               int64_t ab = 0,
               enum AVSampleFormat sample_fmt = AV_SAMPLE_FMT_FLTP)
       : audio_frame_(av_frame_alloc(), &frame_deleter),
-        audio_fifo_(av_audio_fifo_alloc(sample_fmt, ac, ar), &av_audio_fifo_free),
-        resampler_(sample_rate, ChannelLayoutHelper{nb_channels}.get(), AV_SAMPLE_FMT_S16,
-                   ar, ChannelLayoutHelper{ac}.get(), sample_fmt),
+        resampler_(opts.sample_rate, ChannelLayoutHelper{opts.nb_channels, opts.channel_layout}.get(),
+                   resampler_sample_fmt(opts),
+                   encoder_sample_rate(opts, ar), ChannelLayoutHelper{ac}.get(), sample_fmt),
         audio_encode_helper_(acodec,
                              std::bind(&av_streamer::on_audio_pkt,
                                        this,
-                                       std::placeholders::_1))
+                                       std::placeholders::_1)),
+        opts_(opts),
+        in_sample_fmt_(input_sample_fmt(opts)),
+        in_sample_size_(opts.nb_channels * av_get_bytes_per_sample(in_sample_fmt_))
   {
-    if (!audio_frame_ || !audio_fifo_) {
+    if (!audio_frame_) {
       throw std::runtime_error("av_streamer: Cannot allocate memory");
     }
 
-    DictHelper tcp_opts;
-    if ((av_dict_set(&tcp_opts.get(), "tcp_timeout", "2500000", 0) < 0) ||
-        (av_dict_set(&tcp_opts.get(), "tcp_nodelay", "1", 0) < 0)) {
-      throw std::runtime_error("av_streamer: error setting tcp opts");
-    }
-
-    // setup muxer
-    if (muxer_.open(url, "flv", nullptr, &tcp_opts.get()) < 0) {
-      throw std::runtime_error("av_streamer: error opening muxer");
+    // a blocked encode task would hold the pool thread its drain needs
+    if (opts.pool && opts.io_pool == opts.pool && opts.drop_policy == AV_STREAMER_QUEUE_BLOCK) {
+      throw std::invalid_argument("av_streamer: AV_STREAMER_QUEUE_BLOCK needs an io_pool other than pool");
     }
 
     auto& audio_encoder = audio_encode_helper_.encoder_;
     AVCodecContext* audio_enc_ctx = audio_encoder.ctx();
-    AVFormatContext* mux_ctx = muxer_.ctx();
-
-    // setup audio encoder
-    audio_enc_ctx->bit_rate = ab;
-    audio_enc_ctx->time_base = av_make_q(1, ar);
-    audio_enc_ctx->sample_rate = ar;
-    audio_enc_ctx->sample_fmt = sample_fmt;
-    av_channel_layout_default(&audio_enc_ctx->ch_layout, ac);
-    if (mux_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+    ar = encoder_sample_rate(opts, ar);
+
+    if (opts.audio_input == AV_STREAMER_AUDIO_AAC_ADTS) {
+      setup_adts(opts);
+    } else {
+      // setup audio encoder, outputs may be added later so always use global headers
+      audio_enc_ctx->bit_rate = ab;
+      audio_enc_ctx->time_base = av_make_q(1, ar);
+      audio_enc_ctx->sample_rate = ar;
+      audio_enc_ctx->sample_fmt = sample_fmt;
+      av_channel_layout_default(&audio_enc_ctx->ch_layout, ac);
       audio_enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+      if (audio_encoder.open() < 0) {
+        throw std::runtime_error("av_streamer: error opening audio encoder");
+      }
+
+      // encoder input frames come from recycled buffers
+      audio_frame_pool_ = std::make_unique<AudioFramePool>(
+          audio_enc_ctx->sample_fmt, audio_enc_ctx->ch_layout,
+          audio_enc_ctx->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE ?
+          audio_enc_ctx->sample_rate : audio_enc_ctx->frame_size);
+    }
+    tracks_.push_back(audio_enc_ctx);
+
+    if (opts.width > 0 && opts.height > 0) {
+      setup_video(opts);
+    }
+
+    // setup primary output
+    add_output(opts.url, "flv");
+
+    // start worker, or drain on the shared pool
+    if (opts.async || opts.pool) {
+      int64_t buffer_ms = opts.async_buffer_ms > 0 ? opts.async_buffer_ms : 1000;
+      if (adts_pkt_) {
+        ring_ = std::make_unique<SPSCRing>(av_rescale(adts_ring_bytes_per_sec, buffer_ms, 1000));
+      } else {
+        ring_ = std::make_unique<SPSCRing>(av_rescale(opts.sample_rate, buffer_ms, 1000) * in_sample_size_);
+        ring_gaps_ = std::make_unique<SPSCRing>(max_ring_gaps * sizeof(RingGap));
+      }
+      if (video_track_ >= 0) {
+        video_queue_ = std::make_unique<FrameQueue>(async_video_frames);
+        video_enc_frame_.reset(av_frame_alloc());
+        if (!video_enc_frame_) {
+          throw std::runtime_error("av_streamer: Cannot allocate memory");
+        }
+      }
+      if (opts.pool) {
+        strand_.emplace(opts.pool->make_strand());
+      } else {
+        worker_ = std::thread(&av_streamer::worker_loop, this);
+      }
+    }
+  }
+
+  ~av_streamer() {
+    if (strand_) {
+      // flush what is left in the ring, then wait for our tasks to finish
+      schedule_drain();
+      std::unique_lock<std::mutex> lk(tasks_mtx_);
+      tasks_cv_.wait(lk, [this] { return !tasks_; });
+    }
+    if (worker_.joinable()) {
+      stop_.store(true, std::memory_order_release);
+      wakeup();
+      worker_.join();
+    }
+  }
+
+  // every output gets its own writer thread and queue
+  int add_output(const char* url, const char* format, av_streamer_chunk_fn sink = nullptr) {
+    int queue_size = opts_.mux_queue_size > 0 ? opts_.mux_queue_size : default_mux_queue_size;
+
+    auto output = std::make_shared<StreamOutput>(url, format, tracks_, opts_, queue_size, stats_, std::move(sink));
+
+    std::lock_guard<std::mutex> lk(outputs_mtx_);
+    auto outputs = std::make_shared<OutputList>(*outputs_);
+    int id = next_output_id_++;
+    outputs->emplace_back(id, std::move(output));
+    outputs_ = std::move(outputs);
+    return id;
+  }
+
+  void remove_output(int id) {
+    std::shared_ptr<StreamOutput> output;
+
+    {
+      std::lock_guard<std::mutex> lk(outputs_mtx_);
+      auto outputs = std::make_shared<OutputList>();
+      for (const auto& entry : *outputs_) {
+        if (entry.first == id) {
+          output = entry.second;
+        } else {
+          outputs->push_back(entry);
+        }
+      }
+      if (!output) {
+        throw std::invalid_argument("av_streamer: no such output");
+      }
+      outputs_ = std::move(outputs);
+    }
+
+    // queued packets are discarded and blocked I/O fails, so whoever drops
+    // the last reference is not held up by a hung peer
+    output->abort();
+    std::lock_guard<std::mutex> lk(outputs_mtx_);
+    removed_dropped_packets_ += output->dropped();
+  }
+
+  // returns false if the frame is dropped
+  bool write_video(const uint8_t* const* planes, const int* strides, int64_t pts) {
+    if (video_track_ < 0) {
+      throw std::runtime_error("av_streamer: no video track");
+    }
+
+    if (video_queue_ && failed_.load(std::memory_order_acquire)) {
+      throw std::runtime_error("av_streamer: worker terminated");
+    }
+
+    pts = video_timeline_pts(pts);
+
+    // the encoder or the queue may still hold the last buffer, take a new one
+    AVCodecContext* video_enc_ctx = video_encode_helper_->encoder_.ctx();
+    if (!av_frame_is_writable(video_frame_.get())) {
+      av_frame_unref(video_frame_.get());
+      video_frame_->format = video_enc_ctx->pix_fmt;
+      video_frame_->width = video_enc_ctx->width;
+      video_frame_->height = video_enc_ctx->height;
+      if (av_frame_get_buffer(video_frame_.get(), 0) < 0) {
+        throw std::runtime_error("av_streamer: error getting video_buffer");
+      }
+    }
+
+    for (int i = 0; i != 3; ++i) {
+      int w = i ? (video_enc_ctx->width + 1) >> 1 : video_enc_ctx->width;
+      int h = i ? (video_enc_ctx->height + 1) >> 1 : video_enc_ctx->height;
+      av_image_copy_plane(video_frame_->data[i], video_frame_->linesize[i],
+                          planes[i], strides[i], w, h);
+    }
+    video_frame_->pts = pts;
+
+    if (!video_queue_) {
+      encode_video(video_frame_.get());
+      return true;
+    }
+
+    if (!video_queue_->try_push(video_frame_.get())) {
+      dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    if (strand_) {
+      schedule_drain();
+    } else {
+      wakeup();
+    }
+    return true;
+  }
+
+  inline bool planar_input() const { return av_sample_fmt_is_planar(in_sample_fmt_); }
+
+  // returns false if the samples are dropped
+  bool write_audio(const uint8_t* const* data, int nb_samples) {
+    if (adts_pkt_) {
+      throw std::runtime_error("av_streamer: expecting ADTS input");
+    }
+
+    start_audio_timeline();
+
+    if (!ring_) {
+      stats_.in_samples.fetch_add(nb_samples, std::memory_order_relaxed);
+      encode_audio(data, nb_samples);
+      return true;
     }
-    audio_encoder.open();
 
-    // setup audio stream
-    audio_stream_ = muxer_.new_stream();
-    if (!audio_stream_) {
-      throw std::runtime_error("av_streamer: error creating audio_stream");
+    if (failed_.load(std::memory_order_acquire)) {
+      throw std::runtime_error("av_streamer: worker terminated");
     }
-    if (avcodec_parameters_from_context(audio_stream_->codecpar, audio_enc_ctx) < 0) {
-      throw std::runtime_error("av_streamer: error copying audio_codecpar");
+
+    // The ring holds interleaved samples, planar input is interleaved straight
+    // into it. The ring is sized in whole sample frames, so a wrap never splits one.
+    size_t size = static_cast<size_t>(nb_samples) * in_sample_size_;
+    std::pair<uint8_t*, size_t> spans[2];
+    if (!ring_->reserve(size, spans)) {
+      dropped_samples_.fetch_add(nb_samples, std::memory_order_relaxed);
+      ring_gap_samples_ += nb_samples;
+      return false;
+    }
+    if (av_sample_fmt_is_planar(in_sample_fmt_)) {
+      int n = static_cast<int>(spans[0].second / in_sample_size_);
+      interleave(data, 0, n, spans[0].first);
+      interleave(data, n, nb_samples - n, spans[1].first);
+    } else {
+      memcpy(spans[0].first, data[0], spans[0].second);
+      memcpy(spans[1].first, data[0] + spans[0].second, spans[1].second);
+    }
+
+    // the worker must see where the dropped samples were before the samples after them;
+    // if the gap ring is full the gap is recorded with a later write
+    if (ring_gap_samples_) {
+      RingGap gap{ring_written_, ring_gap_samples_};
+      if (ring_gaps_->write(reinterpret_cast<const uint8_t*>(&gap), sizeof(gap))) {
+        ring_gap_samples_ = 0;
+      }
+    }
+    ring_->commit(size);
+    ring_written_ += size;
+
+    stats_.in_samples.fetch_add(nb_samples, std::memory_order_relaxed);
+    if (strand_) {
+      schedule_drain();
+    } else {
+      wakeup();
+    }
+    return true;
+  }
+
+  // returns false if the data is dropped
+  bool write_audio_packets(const uint8_t* data, int size) {
+    if (!adts_pkt_) {
+      throw std::runtime_error("av_streamer: expecting PCM input");
+    }
+
+    start_audio_timeline();
+
+    if (!ring_) {
+      feed_adts(data, size);
+      return true;
+    }
+
+    if (failed_.load(std::memory_order_acquire)) {
+      throw std::runtime_error("av_streamer: worker terminated");
     }
-    audio_stream_->time_base = av_make_q(1, 1000); // 1ms for flv
 
-    // write flv header
-    if (muxer_.write_header() < 0) {
-      throw std::runtime_error("av_streamer: error writing header");
+    if (!ring_->write(data, size)) {
+      return false;
     }
+
+    if (strand_) {
+      schedule_drain();
+    } else {
+      wakeup();
+    }
+    return true;
   }
 
-  ~av_streamer() = default;
+  void get_stats(av_streamer_stats_t* stats) {
+    *stats = av_streamer_stats_t{};
+    stats->dropped_samples = dropped_samples_.load(std::memory_order_relaxed);
+    stats->in_samples = stats_.in_samples.load(std::memory_order_relaxed);
+    stats->out_packets = stats_.out_packets.load(std::memory_order_relaxed);
+    stats->out_bytes = stats_.out_bytes.load(std::memory_order_relaxed);
+    stats->net_writes = stats_.net_writes.load(std::memory_order_relaxed);
+    stats->net_bytes = stats_.net_bytes.load(std::memory_order_relaxed);
+    stats->frame_allocs = audio_frame_pool_ ? audio_frame_pool_->allocations() : 0;
+    stats->dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+    stats->rejected_frames = rejected_frames_.load(std::memory_order_relaxed);
+    StreamerStats::fill(&stats->resample, stats_.resample);
+    StreamerStats::fill(&stats->frame, stats_.frame);
+    StreamerStats::fill(&stats->encode, stats_.encode);
+    StreamerStats::fill(&stats->video_encode, stats_.video_encode);
+    StreamerStats::fill(&stats->mux, stats_.mux);
+    StreamerStats::fill(&stats->net, stats_.net);
 
-  void write_audio(const uint8_t* const* data, int nb_samples) {
-    if (resampler_.resample(data, nb_samples, audio_fifo_.get()) < 0) {
-      throw std::runtime_error("av_streamer: error resampling audio_data");
+    std::lock_guard<std::mutex> lk(outputs_mtx_);
+    stats->dropped_packets = removed_dropped_packets_;
+    for (const auto& entry : *outputs_) {
+      stats->dropped_packets += entry.second->dropped();
+      stats->queued_packets += entry.second->queued();
     }
+  }
+
+ private:
+  // AAC frames are 1024 samples, 64 ms at 16 kHz, with as much encoder delay.
+  // Low latency encodes at 48 kHz instead (21 ms) and stays playable over FLV,
+  // unlike AAC-LD or Opus.
+  static int encoder_sample_rate(const av_streamer_opts_t& opts, int ar) {
+    return opts.low_latency && ar < 48000 ? 48000 : ar;
+  }
+
+  static constexpr int adts_frame_samples = 1024;
+  static constexpr int default_mux_queue_size = 256;
+  static constexpr std::size_t async_video_frames = 8;  // queued raw frames in async mode
+  static constexpr int64_t adts_ring_bytes_per_sec = 64 * 1024;  // 512 kbit/s of AAC
+
+  // input samples dropped by a full ring, before byte pos of the ring's stream
+  struct RingGap {
+    uint64_t pos;
+    int64_t nb_samples;
+  };
+
+  static constexpr size_t max_ring_gaps = 64;
 
+  static enum AVSampleFormat input_sample_fmt(const av_streamer_opts_t& opts) {
+    static constexpr enum AVSampleFormat fmts[] = {
+      AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_DBL,
+      AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_DBLP,
+    };
+    if (opts.sample_fmt < 0 || opts.sample_fmt >= static_cast<int>(std::size(fmts))) {
+      throw std::invalid_argument("av_streamer: invalid sample_fmt");
+    }
+    return fmts[opts.sample_fmt];
+  }
+
+  // the worker reads interleaved samples back from the ring
+  static enum AVSampleFormat resampler_sample_fmt(const av_streamer_opts_t& opts) {
+    enum AVSampleFormat fmt = input_sample_fmt(opts);
+    return (opts.async || opts.pool) ? av_get_packed_sample_fmt(fmt) : fmt;
+  }
+
+  // samples [offset, offset + nb_samples) of planes
+  void interleave(const uint8_t* const* planes, int offset, int nb_samples, uint8_t* dst) {
+    switch (av_get_bytes_per_sample(in_sample_fmt_)) {
+      case 2:
+        interleave_samples<int16_t>(planes, opts_.nb_channels, offset, nb_samples, dst);
+        break;
+      case 4:
+        interleave_samples<int32_t>(planes, opts_.nb_channels, offset, nb_samples, dst);
+        break;
+      case 8:
+        interleave_samples<int64_t>(planes, opts_.nb_channels, offset, nb_samples, dst);
+        break;
+      default:
+        throw std::runtime_error("av_streamer: unsupported sample size");
+    }
+  }
+
+  // The encoder context only describes the AAC track to the muxers, it is never opened.
+  void setup_adts(const av_streamer_opts_t& opts) {
+    static constexpr int sample_rates[] = {
+      96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350,
+    };
     AVCodecContext* audio_enc_ctx = audio_encode_helper_.encoder_.ctx();
-    int frame_size = audio_enc_ctx->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE ?
-                     audio_enc_ctx->sample_rate : audio_enc_ctx->frame_size;
-
-    while (av_audio_fifo_size(audio_fifo_.get()) >= frame_size) {
-      if (audio_frame_->nb_samples != frame_size) {
-        av_frame_unref(audio_frame_.get());
-        audio_frame_->nb_samples = frame_size;
-        audio_frame_->format = audio_enc_ctx->sample_fmt;
-        av_channel_layout_copy(&audio_frame_->ch_layout, &audio_enc_ctx->ch_layout);
-        if (av_frame_get_buffer(audio_frame_.get(), 0) < 0) {
+    int sr_index = static_cast<int>(std::find(std::begin(sample_rates), std::end(sample_rates), opts.sample_rate)
+                                    - std::begin(sample_rates));
+    int ch_config = opts.nb_channels == 8 ? 7 : opts.nb_channels;
+
+    if (sr_index == static_cast<int>(std::size(sample_rates)) || ch_config < 1 || ch_config > 7) {
+      throw std::invalid_argument("av_streamer: unsupported AAC sample_rate or nb_channels");
+    }
+
+    adts_pkt_.reset(av_packet_alloc());
+    audio_enc_ctx->extradata = static_cast<uint8_t*>(av_mallocz(2 + AV_INPUT_BUFFER_PADDING_SIZE));
+    if (!adts_pkt_ || !audio_enc_ctx->extradata) {
+      throw std::runtime_error("av_streamer: Cannot allocate memory");
+    }
+
+    // AudioSpecificConfig of AAC-LC, and the matching ADTS header bits
+    audio_enc_ctx->extradata[0] = static_cast<uint8_t>((2 << 3) | (sr_index >> 1));
+    audio_enc_ctx->extradata[1] = static_cast<uint8_t>(((sr_index & 1) << 7) | (ch_config << 3));
+    audio_enc_ctx->extradata_size = 2;
+    adts_config_ = (1 << 7) | (sr_index << 3) | ch_config;
+
+    audio_enc_ctx->time_base = av_make_q(1, opts.sample_rate);
+    audio_enc_ctx->sample_rate = opts.sample_rate;
+    audio_enc_ctx->frame_size = adts_frame_samples;
+    if (av_channel_layout_copy(&audio_enc_ctx->ch_layout,
+                               &ChannelLayoutHelper{opts.nb_channels, opts.channel_layout}.get()) < 0) {
+      throw std::runtime_error("av_streamer: error copying ch_layout");
+    }
+  }
+
+  // frames may be split across calls, the incomplete tail is carried over
+  void feed_adts(const uint8_t* data, size_t size) {
+    if (adts_carry_.empty()) {
+      size_t used = mux_adts(data, size);
+      adts_carry_.assign(data + used, data + size);
+    } else {
+      adts_carry_.insert(adts_carry_.end(), data, data + size);
+      size_t used = mux_adts(adts_carry_.data(), adts_carry_.size());
+      adts_carry_.erase(adts_carry_.begin(), adts_carry_.begin() + used);
+    }
+  }
+
+  // Muxes the complete ADTS frames at the start of data, returns the bytes used.
+  // Bytes that do not start a valid header are skipped, resyncing after a drop.
+  size_t mux_adts(const uint8_t* data, size_t size) {
+    static constexpr size_t header_size = 7;
+    size_t pos = 0;
+
+    while (size - pos >= header_size) {
+      const uint8_t* h = data + pos;
+      size_t frame_size = ((h[3] & 0x03) << 11) | (h[4] << 3) | (h[5] >> 5);
+      size_t skip = (h[1] & 0x01) ? header_size : header_size + 2;  // CRC
+      int config = ((h[2] >> 6) << 7) | (((h[2] >> 2) & 0x0f) << 3) | ((h[2] & 0x01) << 2) | (h[3] >> 6);
+
+      // sync word, layer 0, one raw data block, our stream config
+      if (h[0] != 0xff || (h[1] & 0xf6) != 0xf0 || (h[6] & 0x03) || frame_size <= skip) {
+        ++pos;
+        continue;
+      }
+      if (config != adts_config_) {
+        throw std::runtime_error("av_streamer: ADTS stream does not match sample_rate or nb_channels");
+      }
+      if (size - pos < frame_size) {
+        break;
+      }
+
+      if (av_new_packet(adts_pkt_.get(), static_cast<int>(frame_size - skip)) < 0) {
+        throw std::runtime_error("av_streamer: Cannot allocate memory");
+      }
+      memcpy(adts_pkt_->data, h + skip, frame_size - skip);
+      adts_pkt_->pts = adts_pkt_->dts = audio_pts_;
+      adts_pkt_->duration = adts_frame_samples;
+      adts_pkt_->flags |= AV_PKT_FLAG_KEY;
+      audio_pts_ += adts_frame_samples;
+      stats_.in_samples.fetch_add(adts_frame_samples, std::memory_order_relaxed);
+
+      on_audio_pkt(adts_pkt_.get());
+      av_packet_unref(adts_pkt_.get());
+      pos += frame_size;
+    }
+
+    return pos;
+  }
+
+  void setup_video(const av_streamer_opts_t& opts) {
+    video_encode_helper_ = std::make_unique<EncodeHelper>(AV_CODEC_ID_H264,
+                                                          std::bind(&av_streamer::on_video_pkt,
+                                                                    this,
+                                                                    std::placeholders::_1));
+    video_frame_.reset(av_frame_alloc());
+    if (!video_frame_) {
+      throw std::runtime_error("av_streamer: Cannot allocate memory");
+    }
+
+    auto& video_encoder = video_encode_helper_->encoder_;
+    AVCodecContext* video_enc_ctx = video_encoder.ctx();
+    int frame_rate = opts.frame_rate > 0 ? opts.frame_rate : 25;
+
+    // setup video encoder
+    video_enc_ctx->bit_rate = opts.video_bit_rate;
+    video_enc_ctx->width = opts.width;
+    video_enc_ctx->height = opts.height;
+    video_enc_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    video_enc_ctx->time_base = av_make_q(1, 1000);
+    video_enc_ctx->framerate = av_make_q(frame_rate, 1);
+    video_enc_ctx->gop_size = frame_rate * 2;
+    video_enc_ctx->max_b_frames = 0;
+    video_encoder.set_threads(opts.video_threads);
+    video_enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    DictHelper video_opts;
+    if (av_dict_set(&video_opts.get(), "preset", "veryfast", 0) < 0) {
+      throw std::runtime_error("av_streamer: error setting video opts");
+    }
+    if (opts.low_latency) {
+      // no lookahead or frame threads, each adds frames of delay
+      video_encoder.set_threads(opts.video_threads, FF_THREAD_SLICE);
+      if (av_dict_set(&video_opts.get(), "tune", "zerolatency", 0) < 0) {
+        throw std::runtime_error("av_streamer: error setting video opts");
+      }
+    }
+    if (video_encoder.open(&video_opts.get()) < 0) {
+      throw std::runtime_error("av_streamer: error opening video encoder");
+    }
+
+    video_frame_->format = video_enc_ctx->pix_fmt;
+    video_frame_->width = video_enc_ctx->width;
+    video_frame_->height = video_enc_ctx->height;
+    if (av_frame_get_buffer(video_frame_.get(), 0) < 0) {
+      throw std::runtime_error("av_streamer: error getting video_buffer");
+    }
+
+    video_track_ = static_cast<int>(tracks_.size());
+    tracks_.push_back(video_enc_ctx);
+  }
+
+  // Both tracks start on the clock of the first write to either of them, so
+  // a track that starts later starts at its offset from that first write.
+  int64_t elapsed_since_origin_us() {
+    uint64_t now = LatencyHistogram::now_ns();
+    uint64_t origin = 0;
+    if (origin_ns_.compare_exchange_strong(origin, now, std::memory_order_acq_rel)) {
+      origin = now;
+    }
+    return static_cast<int64_t>((now - origin) / 1000);
+  }
+
+  // audio pts count samples from the first write, the worker sees them through the ring
+  void start_audio_timeline() {
+    if (!audio_started_) {
+      audio_started_ = true;
+      audio_pts_ = av_rescale_q(elapsed_since_origin_us(), av_make_q(1, AV_TIME_BASE), tracks_[0]->time_base);
+    }
+  }
+
+  // video keeps the caller's pts deltas, and must not go backwards
+  int64_t video_timeline_pts(int64_t pts) {
+    if (video_pts_ == AV_NOPTS_VALUE) {
+      video_pts_offset_ = pts - elapsed_since_origin_us() / 1000;
+    }
+    pts -= video_pts_offset_;
+    if (video_pts_ != AV_NOPTS_VALUE && pts <= video_pts_) {
+      rejected_frames_.fetch_add(1, std::memory_order_relaxed);
+      throw std::invalid_argument("av_streamer: video pts must increase");
+    }
+    return video_pts_ = pts;
+  }
+
+  void encode_video(AVFrame* frame) {
+    video_deliver_ns_ = 0;
+    uint64_t start_ns = LatencyHistogram::now_ns();
+    if (video_encode_helper_->encode(frame) < 0) {
+      throw std::runtime_error("av_streamer: error encoding video_frame");
+    }
+    stats_.video_encode.record(LatencyHistogram::now_ns() - start_ns - video_deliver_ns_);
+  }
+
+  // Resamples straight into the encoder frame, a partly filled frame is carried to the next call.
+  void encode_audio(const uint8_t* const* data, int nb_samples) {
+    int frame_size = audio_frame_pool_->nb_samples();
+
+    for (;;) {
+      // a fresh pooled buffer, the encoder may still hold the previous one
+      if (!audio_filled_) {
+        ScopedLatency latency(stats_.frame);
+        if (audio_frame_pool_->get(audio_frame_.get()) < 0) {
           throw std::runtime_error("av_streamer: error getting audio_buffer");
         }
-      } else {
-        if (av_frame_make_writable(audio_frame_.get()) < 0) {
-          throw std::runtime_error("av_streamer: error copying audio_buffer");
-        }
       }
 
-      int rc = av_audio_fifo_read(audio_fifo_.get(),
-                                  reinterpret_cast<void* const*>(audio_frame_->data),
-                                  frame_size);
-      if (rc != frame_size) {
-        throw std::runtime_error("av_streamer: error reading audio_fifo");
+      int rc = 0;
+      {
+        ScopedLatency latency(stats_.resample);
+        rc = resampler_.resample(data, nb_samples, audio_frame_.get(), audio_filled_);
+      }
+      if (rc < 0) {
+        throw std::runtime_error("av_streamer: error resampling audio_data");
       }
 
+      // the rest of the input is buffered by the resampler now
+      nb_samples = 0;
+      audio_filled_ += rc;
+      if (audio_filled_ < frame_size) {
+        break;
+      }
+      audio_filled_ = 0;
+
       audio_frame_->pts = audio_pts_;
       audio_pts_ += frame_size;
 
+      audio_deliver_ns_ = 0;
+      uint64_t start_ns = LatencyHistogram::now_ns();
       if (audio_encode_helper_.encode(audio_frame_.get()) < 0) {
         throw std::runtime_error("av_streamer: error encoding audio_frame");
       }
+      stats_.encode.record(LatencyHistogram::now_ns() - start_ns - audio_deliver_ns_);
     }
   }
 
- private:
+  // delivery time is excluded from the encode stage
   void on_audio_pkt(AVPacket* pkt) {
-    AVCodecContext* audio_enc_ctx = audio_encode_helper_.encoder_.ctx();
-    av_packet_rescale_ts(pkt, audio_enc_ctx->time_base, audio_stream_->time_base);
-    pkt->stream_index = audio_stream_->index;
-    if (muxer_.interleaved_write_frame(pkt) < 0) {
-      throw std::runtime_error("av_streamer: error writing audio_packet");
+    uint64_t start_ns = LatencyHistogram::now_ns();
+    pkt->stream_index = 0;
+    mux_packet(pkt);
+    audio_deliver_ns_ += LatencyHistogram::now_ns() - start_ns;
+  }
+
+  void on_video_pkt(AVPacket* pkt) {
+    uint64_t start_ns = LatencyHistogram::now_ns();
+    pkt->stream_index = video_track_;
+    mux_packet(pkt);
+    video_deliver_ns_ += LatencyHistogram::now_ns() - start_ns;
+  }
+
+  void mux_packet(const AVPacket* pkt) {
+    stats_.out_packets.fetch_add(1, std::memory_order_relaxed);
+    stats_.out_bytes.fetch_add(pkt->size, std::memory_order_relaxed);
+
+    auto outputs = get_outputs();
+    bool ok = outputs->empty();
+    for (const auto& entry : *outputs) {
+      ok = entry.second->send(pkt) || ok;
+    }
+    if (!ok) {
+      throw std::runtime_error("av_streamer: all outputs failed");
+    }
+  }
+
+  inline std::shared_ptr<const OutputList> get_outputs() {
+    std::lock_guard<std::mutex> lk(outputs_mtx_);
+    return outputs_;
+  }
+
+  inline void wakeup() {
+    wakeups_.fetch_add(1, std::memory_order_release);
+    wakeups_.notify_one();
+  }
+
+  void worker_loop() {
+    for (;;) {
+      uint32_t seq = wakeups_.load(std::memory_order_acquire);
+      bool stop = stop_.load(std::memory_order_acquire);
+
+      try {
+        drain();
+      } catch (...) {
+        failed_.store(true, std::memory_order_release);
+        return;
+      }
+
+      if (stop) {
+        return;
+      }
+
+      wakeups_.wait(seq, std::memory_order_acquire);
+    }
+  }
+
+  // at most one drain is queued on the strand, later writes are picked up by it
+  void schedule_drain() {
+    if (drain_pending_.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(tasks_mtx_);
+      ++tasks_;
+    }
+    boost::asio::post(*strand_, [this] { pool_drain(); });
+  }
+
+  void pool_drain() {
+    // cleared first, so samples written during the drain post a new one
+    drain_pending_.store(false, std::memory_order_release);
+
+    if (!failed_.load(std::memory_order_acquire)) {
+      try {
+        drain();
+      } catch (...) {
+        failed_.store(true, std::memory_order_release);
+      }
+    }
+
+    std::lock_guard<std::mutex> lk(tasks_mtx_);
+    if (!--tasks_) {
+      tasks_cv_.notify_all();
+    }
+  }
+
+  void drain() {
+    drain_ring();
+    if (video_queue_) {
+      drain_video();
+    }
+  }
+
+  void drain_video() {
+    while (video_queue_->try_pop(video_enc_frame_.get())) {
+      encode_video(video_enc_frame_.get());
+      av_frame_unref(video_enc_frame_.get());
+    }
+  }
+
+  void drain_ring() {
+    for (;;) {
+      auto [data, size] = ring_->read_span();
+      if (!size) {
+        break;
+      }
+      if (adts_pkt_) {
+        feed_adts(data, size);
+        ring_->consume(size);
+        continue;
+      }
+      size = skip_ring_gaps(size);
+      const uint8_t* planes[1] = {data};
+      encode_audio(planes, static_cast<int>(size / in_sample_size_));
+      ring_->consume(size);
+      ring_read_ += size;
+    }
+  }
+
+  // Moves audio_pts_ over the samples dropped at the read position, so audio
+  // stays on the clock video is anchored to. Returns how much of size can be
+  // read before the next gap.
+  size_t skip_ring_gaps(size_t size) {
+    for (;;) {
+      auto [data, n] = ring_gaps_->read_span();
+      if (n < sizeof(RingGap)) {
+        return size;
+      }
+      RingGap gap;
+      memcpy(&gap, data, sizeof(gap));
+      if (gap.pos > ring_read_) {
+        return std::min<size_t>(size, gap.pos - ring_read_);
+      }
+      audio_pts_ += av_rescale_q(gap.nb_samples, av_make_q(1, opts_.sample_rate), tracks_[0]->time_base);
+      ring_gaps_->consume(sizeof(gap));
     }
   }
 
   std::unique_ptr<AVFrame, decltype(&frame_deleter)> audio_frame_;
-  std::unique_ptr<AVAudioFifo, decltype(&av_audio_fifo_free)> audio_fifo_;
+  std::unique_ptr<AudioFramePool> audio_frame_pool_;
   Resampler resampler_;
   EncodeHelper audio_encode_helper_;
-  Muxer muxer_;
-  AVStream* audio_stream_ = nullptr;
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> video_frame_{nullptr, &frame_deleter};
+  std::unique_ptr<EncodeHelper> video_encode_helper_;
+  std::vector<AVCodecContext*> tracks_;
+  int video_track_ = -1;
+  const av_streamer_opts_t opts_;
+  StreamerStats stats_;
+  std::mutex outputs_mtx_;
+  std::shared_ptr<const OutputList> outputs_ = std::make_shared<OutputList>();
+  int next_output_id_ = 0;
+  uint64_t removed_dropped_packets_ = 0;
+  int audio_filled_ = 0;
   int64_t audio_pts_ = 0;
+  int64_t video_pts_ = AV_NOPTS_VALUE;
+  int64_t video_pts_offset_ = 0;
+  bool audio_started_ = false;
+  std::atomic<uint64_t> origin_ns_{0};
+  uint64_t audio_deliver_ns_ = 0;
+  uint64_t video_deliver_ns_ = 0;
+  const enum AVSampleFormat in_sample_fmt_;
+  const size_t in_sample_size_;
+  std::unique_ptr<SPSCRing> ring_;
+  std::unique_ptr<SPSCRing> ring_gaps_;  // PCM ring only, RingGap records
+  uint64_t ring_written_ = 0;  // producer side, bytes committed to ring_
+  int64_t ring_gap_samples_ = 0;  // producer side, dropped and not yet recorded
+  uint64_t ring_read_ = 0;  // worker side, bytes consumed from ring_
+  std::unique_ptr<FrameQueue> video_queue_;  // async mode with video
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> video_enc_frame_{nullptr, &frame_deleter};
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> adts_pkt_{nullptr, &pkt_deleter};  // ADTS input only
+  std::vector<uint8_t> adts_carry_;
+  int adts_config_ = 0;  // profile, sample rate index and channel config bits
+  std::thread worker_;
+  std::optional<StreamerPool::strand_type> strand_;
+  std::atomic<bool> drain_pending_{false};
+  std::mutex tasks_mtx_;
+  std::condition_variable tasks_cv_;
+  int tasks_ = 0;
+  std::atomic<uint32_t> wakeups_{0};
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> failed_{false};
+  std::atomic<uint64_t> dropped_samples_{0};
+  std::atomic<uint64_t> dropped_frames_{0};
+  std::atomic<uint64_t> rejected_frames_{0};
 };
 
+av_streamer_pool_t* av_streamer_pool_alloc(int nb_threads, int pin_threads) {
+  try {
+    return new av_streamer_pool(nb_threads > 0 ? nb_threads : 0, pin_threads != 0);
+  } catch (...) { return nullptr; }
+}
+
+void av_streamer_pool_free(av_streamer_pool_t* p_pool) {
+  delete p_pool;
+}
+
+void av_streamer_opts_default(av_streamer_opts_t* opts) {
+  *opts = av_streamer_opts_t{};
+  opts->sample_rate = 16000;
+  opts->nb_channels = 1;
+  opts->async_buffer_ms = 1000;
+  opts->frame_rate = 25;
+}
+
 av_streamer_t* av_streamer_alloc(int sample_rate, int nb_channels,
                                  const char* url) {
+  av_streamer_opts_t opts;
+  av_streamer_opts_default(&opts);
+  opts.sample_rate = sample_rate;
+  opts.nb_channels = nb_channels;
+  opts.url = url;
+  return av_streamer_alloc2(&opts);
+}
+
+av_streamer_t* av_streamer_alloc2(const av_streamer_opts_t* opts) {
   try {
-    return new av_streamer(sample_rate, nb_channels, url);
+    return new av_streamer(*opts);
   } catch (...) { return nullptr; }
 }
 
@@ -195,12 +1297,93 @@ void av_streamer_free(av_streamer_t* p_streamer) {
   delete p_streamer;
 }
 
+int av_streamer_write_audio_packets(av_streamer_t* p_streamer,
+                                    const unsigned char* data,
+                                    int size) {
+  try {
+    if (size < 0) {
+      return -1;
+    }
+    return p_streamer->write_audio_packets(data, size) ? 0 : 1;
+  } catch (...) { return -1; }
+}
+
+int av_streamer_write_video(av_streamer_t* p_streamer,
+                            const unsigned char* const planes[3],
+                            const int strides[3],
+                            int64_t pts) {
+  try {
+    return p_streamer->write_video(planes, strides, pts) ? 0 : 1;
+  } catch (...) { return -1; }
+}
+
+int av_streamer_add_output(av_streamer_t* p_streamer,
+                           const char* url,
+                           const char* format) {
+  try {
+    return p_streamer->add_output(url, format);
+  } catch (...) { return -1; }
+}
+
+int av_streamer_add_chunk_output(av_streamer_t* p_streamer,
+                                 const char* format,
+                                 av_streamer_chunk_cb cb,
+                                 void* opaque) {
+  try {
+    if (!cb) {
+      return -1;
+    }
+    return p_streamer->add_output(nullptr, format,
+        [cb, opaque](std::shared_ptr<const std::string> chunk, int flags) {
+          cb(opaque, reinterpret_cast<const unsigned char*>(chunk->data()),
+             static_cast<int>(chunk->size()), flags);
+        });
+  } catch (...) { return -1; }
+}
+
+int av_streamer_add_chunk_output(av_streamer_t* p_streamer,
+                                 const char* format,
+                                 av_streamer_chunk_fn fn) {
+  try {
+    if (!fn) {
+      return -1;
+    }
+    return p_streamer->add_output(nullptr, format, std::move(fn));
+  } catch (...) { return -1; }
+}
+
+int av_streamer_remove_output(av_streamer_t* p_streamer,
+                              int output_id) {
+  try {
+    p_streamer->remove_output(output_id);
+    return 0;
+  } catch (...) { return -1; }
+}
+
+int av_streamer_get_stats(av_streamer_t* p_streamer,
+                          av_streamer_stats_t* stats) {
+  try {
+    p_streamer->get_stats(stats);
+    return 0;
+  } catch (...) { return -1; }
+}
+
 int av_streamer_write_audio(av_streamer_t* p_streamer,
                             const unsigned char* audio_data,
                             int nb_samples) {
   try {
+    if (p_streamer->planar_input()) {
+      return -1;
+    }
     const uint8_t* data[1] = {audio_data};
-    p_streamer->write_audio(data, nb_samples);
-    return 0;
+    return p_streamer->write_audio(data, nb_samples) ? 0 : 1;
+  } catch (...) { return -1; }
+}
+
+int av_streamer_write_audio2(av_streamer_t* p_streamer,
+                             const unsigned char* const* audio_data,
+                             int nb_samples) {
+  try {
+    return p_streamer->write_audio(audio_data, nb_samples) ? 0 : 1;
   } catch (...) { return -1; }
 }
@@ -8,23 +8,198 @@
 #ifndef av_streamer_h
 #define av_streamer_h
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct av_streamer av_streamer_t;
 
+typedef struct av_streamer_pool av_streamer_pool_t;
+
+enum {
+  AV_STREAMER_OUTPUT_FFMPEG = 0,  // ffmpeg's own protocols (avio_open2)
+  AV_STREAMER_OUTPUT_LIBRTMP,     // librtmp behind a custom AVIOContext
+};
+
+enum {
+  AV_STREAMER_QUEUE_DROP_UNTIL_KEYFRAME = 0, // default: the queue is flushed, each stream restarts at a keyframe
+  AV_STREAMER_QUEUE_DROP_OLDEST,             // the oldest queued packet is dropped
+  AV_STREAMER_QUEUE_BLOCK,                   // the encoder waits, so one slow output stalls every output
+};
+
+enum {
+  AV_STREAMER_SAMPLE_S16 = 0,  // interleaved
+  AV_STREAMER_SAMPLE_S32,
+  AV_STREAMER_SAMPLE_FLT,
+  AV_STREAMER_SAMPLE_DBL,
+  AV_STREAMER_SAMPLE_S16P,     // planar, one buffer per channel
+  AV_STREAMER_SAMPLE_S32P,
+  AV_STREAMER_SAMPLE_FLTP,
+  AV_STREAMER_SAMPLE_DBLP,
+};
+
+enum {
+  AV_STREAMER_AUDIO_PCM = 0,   // raw samples, encoded to AAC by the streamer
+  AV_STREAMER_AUDIO_AAC_ADTS,  // AAC-LC with ADTS headers, muxed as is
+};
+
+enum {
+  AV_STREAMER_CHUNK_HEADER = 1,  // stream header, once before any other chunk
+  AV_STREAMER_CHUNK_KEY = 2,     // starts at a video keyframe, or any chunk without video
+};
+
+// Gets one muxed chunk, data is only valid during the call.
+typedef void (*av_streamer_chunk_cb)(void* opaque, const unsigned char* data,
+                                     int size, int flags);
+
+typedef struct av_streamer_opts {
+  int sample_rate;      // input sample rate
+  int nb_channels;      // input channels
+  const char* url;
+  int async;            // non-zero: resample/encode/mux on a worker thread
+  int async_buffer_ms;  // capacity of the PCM ring in async mode
+  int width;            // video width, 0 disables the video track
+  int height;
+  int frame_rate;
+  int video_bit_rate;   // 0 for encoder default
+  int video_threads;    // 0 for auto
+  int output;           // AV_STREAMER_OUTPUT_*
+  int io_buffer_size;   // AVIO buffer of the librtmp output, 0 for 32768
+  int mux_queue_size;   // packets queued for each output's writer thread, 0 for 256
+  int drop_policy;      // AV_STREAMER_QUEUE_*, applies when an output's queue is full
+  av_streamer_pool_t* pool;  // non-NULL: async, but resample/encode/mux run on the shared pool
+  int low_latency;      // non-zero: short audio frames, zero-latency video, unbuffered outputs
+  int sample_fmt;       // AV_STREAMER_SAMPLE_*, input format
+  uint64_t channel_layout;  // AV_CH_* mask of the input, 0 for the default of nb_channels
+  int audio_input;      // AV_STREAMER_AUDIO_*, AAC must match sample_rate and nb_channels
+  // non-NULL: outputs write on this pool instead of a thread each. With
+  // AV_STREAMER_QUEUE_BLOCK it must not be the same pool as pool, where
+  // encode tasks waiting for room would hold the threads the writes need;
+  // av_streamer_alloc2() returns NULL in that case.
+  av_streamer_pool_t* io_pool;
+} av_streamer_opts_t;
+
+typedef struct av_streamer_stage_stats {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t p50_ns;  // power-of-two resolution
+  uint64_t p99_ns;
+} av_streamer_stage_stats_t;
+
+typedef struct av_streamer_stats {
+  uint64_t dropped_samples;  // input samples dropped by the async ring
+  uint64_t dropped_packets;  // encoded packets dropped by the mux queues
+  uint64_t in_samples;       // input samples accepted
+  uint64_t out_packets;      // encoded packets
+  uint64_t out_bytes;
+  uint64_t queued_packets;   // packets currently waiting in mux queues
+  uint64_t net_writes;       // RTMP_Write calls of librtmp outputs
+  uint64_t net_bytes;
+  uint64_t frame_allocs;     // audio frame buffers allocated, flat in steady state; packets are not counted
+  uint64_t dropped_frames;   // video frames dropped by the async frame queue
+  uint64_t rejected_frames;  // video frames rejected for a pts that did not increase
+  av_streamer_stage_stats_t resample;      // Resampler::resample per call
+  av_streamer_stage_stats_t frame;         // encoder frame setup
+  av_streamer_stage_stats_t encode;        // audio EncodeHelper::encode per frame
+  av_streamer_stage_stats_t video_encode;  // video EncodeHelper::encode per frame
+  av_streamer_stage_stats_t mux;           // Muxer::interleaved_write_frame, all outputs
+  av_streamer_stage_stats_t net;           // RTMP_Write of librtmp outputs
+} av_streamer_stats_t;
+
+// Worker threads shared by many streamers, nb_threads <= 0 for one per core.
+// pin_threads binds each worker to a core where supported. Must outlive
+// every streamer using it.
+av_streamer_pool_t* av_streamer_pool_alloc(int nb_threads, int pin_threads);
+
+void av_streamer_pool_free(av_streamer_pool_t* p_pool);
+
+void av_streamer_opts_default(av_streamer_opts_t* opts);
+
 av_streamer_t* av_streamer_alloc(int sample_rate, int nb_channels,
                                  const char* url);
 
+av_streamer_t* av_streamer_alloc2(const av_streamer_opts_t* opts);
+
 void av_streamer_free(av_streamer_t* p_streamer);
 
+// Publishes the encoded tracks to another output. Like the first one, each
+// output has its own writer thread, queue and failure handling. format may be
+// NULL to guess it from the url. Returns the output id (the url passed at
+// alloc time is output 0), or -1.
+int av_streamer_add_output(av_streamer_t* p_streamer,
+                           const char* url,
+                           const char* format);
+
+// Muxes the encoded tracks to memory instead of a url, for live playback.
+// format is "flv" or "mp4" (fragmented, for Media Source Extensions). cb gets
+// the header, then one chunk per packet for flv, or one per fragment for mp4,
+// on the output's writer thread, and should not block. Returns the output id,
+// or -1.
+int av_streamer_add_chunk_output(av_streamer_t* p_streamer,
+                                 const char* format,
+                                 av_streamer_chunk_cb cb,
+                                 void* opaque);
+
+// Discards the output's queued packets and interrupts its pending write.
+// Only av_streamer_free() drains the queues.
+int av_streamer_remove_output(av_streamer_t* p_streamer,
+                              int output_id);
+
+// Counters and per-stage latencies since alloc, safe to call from any thread.
+int av_streamer_get_stats(av_streamer_t* p_streamer,
+                          av_streamer_stats_t* stats);
+
+// Interleaved sample formats only.
+// Returns 0 on success, -1 on error or once all outputs have failed.
+// In async mode the samples are only copied into the ring, the call never
+// blocks on I/O and returns 1 if the ring is full and the samples are dropped.
+// Later samples are still placed after the dropped ones, so audio stays in
+// sync with video.
 int av_streamer_write_audio(av_streamer_t* p_streamer,
                             const unsigned char* audio_data,
                             int nb_samples);
 
+// Takes one buffer per channel for planar sample formats, a single buffer
+// otherwise. Returns like av_streamer_write_audio.
+int av_streamer_write_audio2(av_streamer_t* p_streamer,
+                             const unsigned char* const* audio_data,
+                             int nb_samples);
+
+// AV_STREAMER_AUDIO_AAC_ADTS input. Frames may be split across calls, each
+// one is timestamped by its sample count. Returns like av_streamer_write_audio,
+// in async mode the whole call is dropped if it does not fit the ring.
+int av_streamer_write_audio_packets(av_streamer_t* p_streamer,
+                                    const unsigned char* data,
+                                    int size);
+
+// I420 planes, pts in milliseconds, must increase or the frame is rejected
+// with -1. The first frame is placed at the time since the first audio or
+// video write, later frames keep the caller's pts deltas. In async mode the
+// frame is copied into a short queue and encoded on the worker, and 1 is
+// returned if the queue is full and the frame is dropped. Otherwise the frame
+// is encoded on the calling thread.
+int av_streamer_write_video(av_streamer_t* p_streamer,
+                            const unsigned char* const planes[3],
+                            const int strides[3],
+                            int64_t pts);
+
 #ifdef __cplusplus
 }
+
+#include <functional>
+#include <memory>
+#include <string>
+
+// C++ only: gets the chunk the muxer produced as a shared payload, so it can
+// be handed on without copying it again.
+using av_streamer_chunk_fn = std::function<void(std::shared_ptr<const std::string> chunk, int flags)>;
+
+int av_streamer_add_chunk_output(av_streamer_t* p_streamer,
+                                 const char* format,
+                                 av_streamer_chunk_fn fn);
 #endif
 
 #endif /* av_streamer_h */
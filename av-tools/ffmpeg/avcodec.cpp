@@ -40,6 +40,11 @@ int CodecBase::open(AVDictionary** opts) {
   return avcodec_open2(ctx_, codec_, opts);
 }
 
+void CodecBase::set_threads(int thread_count, int thread_type) {
+  ctx_->thread_count = thread_count;
+  ctx_->thread_type = thread_type;
+}
+
 CodecBase::CodecBase(const AVCodec* codec)
 {
   if (!(codec_ = codec)) {
@@ -62,6 +67,15 @@ Decoder::Decoder(enum AVCodecID codec_id)
 Decoder::Decoder(const char* codec_name)
     : CodecBase(avcodec_find_decoder_by_name(codec_name)) { }
 
+int Decoder::set_parameters(const AVCodecParameters* par, AVRational pkt_timebase) {
+  int rc = avcodec_parameters_to_context(ctx_, par);
+  if (rc < 0) {
+    return rc;
+  }
+  ctx_->pkt_timebase = pkt_timebase;
+  return 0;
+}
+
 int Decoder::send_packet(const AVPacket* pkt) {
   return avcodec_send_packet(ctx_, pkt);
 }
@@ -28,6 +28,9 @@ class CodecBase {
 
   int open(AVDictionary** opts = nullptr);
 
+  // before open(), thread_count 0 lets the codec pick one per core
+  void set_threads(int thread_count, int thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE);
+
   inline const AVCodec* codec() const { return codec_; }
 
   inline AVCodecContext* ctx() { return ctx_; }
@@ -53,6 +56,9 @@ class Decoder : public CodecBase {
 
   virtual ~Decoder() = default;
 
+  // copies the stream parameters into the context, before open()
+  int set_parameters(const AVCodecParameters* par, AVRational pkt_timebase);
+
   int send_packet(const AVPacket* pkt);
 
   int receive_frame(AVFrame* frame);
@@ -56,6 +56,7 @@ void Demuxer::close() {
 
 Muxer::Muxer(Muxer&& rhs) noexcept
     : avio_(rhs.avio_),
+      int_cb_(rhs.int_cb_),
       ctx_(rhs.ctx_),
       need_close_(rhs.need_close_),
       need_trailer_(rhs.need_trailer_)
@@ -71,6 +72,7 @@ Muxer& Muxer::operator=(Muxer&& rhs) noexcept {
     close();
 
     avio_ = rhs.avio_;
+    int_cb_ = rhs.int_cb_;
     ctx_ = rhs.ctx_;
     need_close_ = rhs.need_close_;
     need_trailer_ = rhs.need_trailer_;
@@ -99,11 +101,13 @@ int Muxer::open(const char* url,
     return rc;
   }
 
+  ctx_->interrupt_callback = int_cb_;
+
   if (!(ctx_->oformat->flags & AVFMT_NOFILE)) {
     if (avio_) {
       ctx_->pb = avio_;
     } else {
-      rc = avio_open2(&ctx_->pb, url, AVIO_FLAG_WRITE, NULL, opts);
+      rc = avio_open2(&ctx_->pb, url, AVIO_FLAG_WRITE, &ctx_->interrupt_callback, opts);
       if (rc < 0) {
         return rc;
       }
@@ -62,6 +62,9 @@ class Muxer {
 
   inline void set_avio(AVIOContext* avio) { avio_ = avio; }
 
+  // checked by blocking protocol I/O, set before open()
+  inline void set_interrupt_callback(const AVIOInterruptCB& cb) { int_cb_ = cb; }
+
   inline AVFormatContext* ctx() { return ctx_; }
 
   int open(const char* url,
@@ -82,6 +85,7 @@ class Muxer {
 
  private:
   AVIOContext* avio_ = nullptr;
+  AVIOInterruptCB int_cb_{};
   AVFormatContext* ctx_ = nullptr;
   bool need_close_ = false;
   bool need_trailer_ = false;
@@ -0,0 +1,280 @@
+//
+//  avio.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "av-tools/ffmpeg/avio.hpp"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+using namespace av::ffmpeg;
+
+AVIOReader::AVIOReader(int io_buffer_size)
+{
+  uint8_t* io_buf = (uint8_t*) av_malloc(io_buffer_size);
+  if (!io_buf) {
+    throw std::runtime_error("AVIOReader: Cannot allocate memory");
+  }
+
+  avio_ = avio_alloc_context(io_buf, io_buffer_size, 0, this,
+                             read_packet, nullptr, nullptr);
+  if (!avio_) {
+    av_freep(&io_buf);
+    throw std::runtime_error("AVIOReader: Cannot allocate memory");
+  }
+}
+
+AVIOReader::~AVIOReader() {
+  clear();
+  av_freep(&avio_->buffer);
+  avio_context_free(&avio_);
+}
+
+int AVIOReader::feed(const AVBufferRef* buf, std::size_t offset, std::size_t size) {
+  if (offset > buf->size) {
+    return AVERROR(EINVAL);
+  }
+  if (!size) {
+    size = buf->size - offset;
+  }
+  if (size > buf->size - offset) {
+    return AVERROR(EINVAL);
+  }
+  if (!size) {
+    return 0;
+  }
+
+  AVBufferRef* ref = av_buffer_ref(buf);
+  if (!ref) {
+    return AVERROR(ENOMEM);
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (closed_) {
+      av_buffer_unref(&ref);
+      return AVERROR_EOF;
+    }
+    chunks_.push_back({ref, ref->data + offset, size});
+    buffered_ += size;
+  }
+  cv_.notify_one();
+
+  return 0;
+}
+
+int AVIOReader::feed(uint8_t* data, std::size_t size,
+                     void (*free_cb)(void* opaque, uint8_t* data), void* opaque) {
+  AVBufferRef* ref = av_buffer_create(data, size, free_cb, opaque, AV_BUFFER_FLAG_READONLY);
+  if (!ref) {
+    return AVERROR(ENOMEM);
+  }
+
+  int rc = feed(ref);
+  // on failure this runs free_cb, the caller's memory is never leaked
+  av_buffer_unref(&ref);
+  return rc;
+}
+
+void AVIOReader::close() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    closed_ = true;
+  }
+  cv_.notify_all();
+}
+
+std::size_t AVIOReader::buffered() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return buffered_;
+}
+
+int AVIOReader::read_packet(void* opaque, uint8_t* buf, int buf_size) {
+  return static_cast<AVIOReader*>(opaque)->read(buf, buf_size);
+}
+
+// returns whatever is buffered (up to buf_size) instead of waiting to fill buf
+int AVIOReader::read(uint8_t* buf, int buf_size) {
+  std::unique_lock<std::mutex> lk(mtx_);
+
+  cv_.wait(lk, [this] { return closed_ || !chunks_.empty(); });
+
+  if (chunks_.empty()) {
+    return AVERROR_EOF;
+  }
+
+  std::size_t n = 0;
+  while (n < static_cast<std::size_t>(buf_size) && !chunks_.empty()) {
+    Chunk& chunk = chunks_.front();
+    std::size_t len = std::min(chunk.size, buf_size - n);
+    std::memcpy(buf + n, chunk.data, len);
+    n += len;
+    chunk.data += len;
+    chunk.size -= len;
+    if (!chunk.size) {
+      av_buffer_unref(&chunk.ref);
+      chunks_.pop_front();
+    }
+  }
+  buffered_ -= n;
+
+  return static_cast<int>(n);
+}
+
+void AVIOReader::clear() {
+  for (Chunk& chunk : chunks_) {
+    av_buffer_unref(&chunk.ref);
+  }
+  chunks_.clear();
+  buffered_ = 0;
+}
+
+AVIOMmapReader::AVIOMmapReader(const char* path, int io_buffer_size)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("AVIOMmapReader: error opening file");
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+    ::close(fd);
+    throw std::runtime_error("AVIOMmapReader: invalid file");
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+
+  // the mapping keeps the file referenced, the fd is not needed afterwards
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("AVIOMmapReader: error mapping file");
+  }
+  map_ = static_cast<uint8_t*>(map);
+  madvise(map_, size_, MADV_SEQUENTIAL);
+  prefetch();
+
+  uint8_t* io_buf = (uint8_t*) av_malloc(io_buffer_size);
+  if (!io_buf) {
+    munmap(map_, size_);
+    throw std::runtime_error("AVIOMmapReader: Cannot allocate memory");
+  }
+
+  avio_ = avio_alloc_context(io_buf, io_buffer_size, 0, this,
+                             read_packet, nullptr, seek);
+  if (!avio_) {
+    av_freep(&io_buf);
+    munmap(map_, size_);
+    throw std::runtime_error("AVIOMmapReader: Cannot allocate memory");
+  }
+}
+
+AVIOMmapReader::~AVIOMmapReader() {
+  av_freep(&avio_->buffer);
+  avio_context_free(&avio_);
+  munmap(map_, size_);
+}
+
+int AVIOMmapReader::read_packet(void* opaque, uint8_t* buf, int buf_size) {
+  auto self = static_cast<AVIOMmapReader*>(opaque);
+  if (self->pos_ >= self->size_) {
+    return AVERROR_EOF;
+  }
+
+  std::size_t n = std::min(static_cast<std::size_t>(buf_size), self->size_ - self->pos_);
+  std::memcpy(buf, self->map_ + self->pos_, n);
+  self->pos_ += n;
+  if (self->pos_ + prefetch_size / 2 > self->prefetched_) {
+    self->prefetch();
+  }
+
+  return static_cast<int>(n);
+}
+
+int64_t AVIOMmapReader::seek(void* opaque, int64_t offset, int whence) {
+  auto self = static_cast<AVIOMmapReader*>(opaque);
+  int64_t pos = 0;
+
+  switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+      return static_cast<int64_t>(self->size_);
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = static_cast<int64_t>(self->pos_) + offset;
+      break;
+    case SEEK_END:
+      pos = static_cast<int64_t>(self->size_) + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+
+  if (pos < 0 || pos > static_cast<int64_t>(self->size_)) {
+    return AVERROR(EINVAL);
+  }
+
+  self->pos_ = static_cast<std::size_t>(pos);
+  self->prefetched_ = self->pos_;
+  self->prefetch();
+
+  return pos;
+}
+
+void AVIOMmapReader::prefetch() {
+  static const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  std::size_t begin = std::max(pos_, prefetched_) / page_size * page_size;
+  std::size_t end = std::min(pos_ + prefetch_size, size_);
+  if (begin < end) {
+    madvise(map_ + begin, end - begin, MADV_WILLNEED);
+  }
+  prefetched_ = end;
+}
+
+AVIOWriter::AVIOWriter(int io_buffer_size)
+{
+  uint8_t* io_buf = (uint8_t*) av_malloc(io_buffer_size);
+  if (!io_buf) {
+    throw std::runtime_error("AVIOWriter: Cannot allocate memory");
+  }
+
+  avio_ = avio_alloc_context(io_buf, io_buffer_size, 1, this,
+                             nullptr, write_packet, nullptr);
+  if (!avio_) {
+    av_freep(&io_buf);
+    throw std::runtime_error("AVIOWriter: Cannot allocate memory");
+  }
+}
+
+AVIOWriter::~AVIOWriter() {
+  av_freep(&avio_->buffer);
+  avio_context_free(&avio_);
+}
+
+std::shared_ptr<const std::string> AVIOWriter::take() {
+  avio_flush(avio_);
+  if (chunk_.empty()) {
+    return nullptr;
+  }
+
+  auto chunk = std::make_shared<const std::string>(std::move(chunk_));
+  chunk_.clear();
+  return chunk;
+}
+
+int AVIOWriter::write_packet(void* opaque, const uint8_t* buf, int buf_size) {
+  static_cast<AVIOWriter*>(opaque)->chunk_.append(reinterpret_cast<const char*>(buf), buf_size);
+  return buf_size;
+}
@@ -0,0 +1,135 @@
+//
+//  avio.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/buffer.h>
+}
+
+namespace av {
+
+namespace ffmpeg {
+
+// Read-only AVIOContext over a chain of refcounted buffers fed by the caller,
+// for Demuxer::set_avio(). feed() takes a reference rather than a copy, but
+// read_packet still copies into the AVIO buffer like any AVIOContext, so each
+// byte is copied once. read_packet blocks until data arrives or close().
+class AVIOReader {
+ public:
+  AVIOReader(const AVIOReader&) = delete;
+  AVIOReader& operator=(const AVIOReader&) = delete;
+
+  explicit AVIOReader(int io_buffer_size = 32768);
+
+  virtual ~AVIOReader();
+
+  // takes a new reference to buf[offset, offset + size), size = 0 for the rest
+  int feed(const AVBufferRef* buf, std::size_t offset = 0, std::size_t size = 0);
+
+  // wraps caller memory, free_cb(opaque, data) runs once it has been read
+  int feed(uint8_t* data, std::size_t size, void (*free_cb)(void* opaque, uint8_t* data), void* opaque);
+
+  // no more data, reads return EOF once the chain is drained
+  void close();
+
+  std::size_t buffered() const;
+
+  inline AVIOContext* ctx() { return avio_; }
+
+ protected:
+  static int read_packet(void* opaque, uint8_t* buf, int buf_size);
+
+  int read(uint8_t* buf, int buf_size);
+
+  void clear();
+
+ private:
+  struct Chunk {
+    AVBufferRef* ref;
+    const uint8_t* data;
+    std::size_t size;
+  };
+
+  AVIOContext* avio_ = nullptr;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<Chunk> chunks_;
+  std::size_t buffered_ = 0;
+  bool closed_ = false;
+};
+
+// Read/seek AVIOContext over a memory-mapped file. Each refill of the AVIO
+// buffer is a memcpy from the mapping instead of a read(2) call; the data is
+// still copied once, as with the file protocol.
+class AVIOMmapReader {
+ public:
+  AVIOMmapReader(const AVIOMmapReader&) = delete;
+  AVIOMmapReader& operator=(const AVIOMmapReader&) = delete;
+
+  explicit AVIOMmapReader(const char* path, int io_buffer_size = 256 * 1024);
+
+  virtual ~AVIOMmapReader();
+
+  inline std::size_t size() const { return size_; }
+
+  inline AVIOContext* ctx() { return avio_; }
+
+ protected:
+  static int read_packet(void* opaque, uint8_t* buf, int buf_size);
+
+  static int64_t seek(void* opaque, int64_t offset, int whence);
+
+  // asks the kernel to prefetch the window ahead of pos_
+  void prefetch();
+
+ private:
+  static constexpr std::size_t prefetch_size = 8 * 1024 * 1024;
+
+  AVIOContext* avio_ = nullptr;
+  uint8_t* map_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t pos_ = 0;
+  std::size_t prefetched_ = 0;  // end of the last WILLNEED window
+};
+
+// Write-only AVIOContext that keeps the muxer output in memory, so it can be
+// cut into chunks at packet boundaries and handed to many readers.
+class AVIOWriter {
+ public:
+  AVIOWriter(const AVIOWriter&) = delete;
+  AVIOWriter& operator=(const AVIOWriter&) = delete;
+
+  explicit AVIOWriter(int io_buffer_size = 4096);
+
+  virtual ~AVIOWriter();
+
+  // flushes the context, returns everything written since the last call or nullptr
+  std::shared_ptr<const std::string> take();
+
+  inline AVIOContext* ctx() { return avio_; }
+
+ protected:
+  static int write_packet(void* opaque, const uint8_t* buf, int buf_size);
+
+ private:
+  AVIOContext* avio_ = nullptr;
+  std::string chunk_;
+};
+
+} // ffmpeg
+
+} // av
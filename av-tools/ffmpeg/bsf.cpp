@@ -0,0 +1,65 @@
+//
+//  bsf.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include <stdexcept>
+#include "av-tools/ffmpeg/bsf.hpp"
+
+using namespace av::ffmpeg;
+
+BitstreamFilter::BitstreamFilter(const char* name, const AVCodecParameters* par, AVRational time_base)
+{
+  const AVBitStreamFilter* filter = av_bsf_get_by_name(name ? name : "null");
+  if (!filter) {
+    throw std::runtime_error("BitstreamFilter: invalid argument");
+  }
+
+  if (av_bsf_alloc(filter, &ctx_) < 0) {
+    throw std::runtime_error("BitstreamFilter: error allocating bsf context");
+  }
+
+  if (avcodec_parameters_copy(ctx_->par_in, par) < 0) {
+    close();
+    throw std::runtime_error("BitstreamFilter: error copying codecpar");
+  }
+  ctx_->time_base_in = time_base;
+
+  if (av_bsf_init(ctx_) < 0) {
+    close();
+    throw std::runtime_error("BitstreamFilter: error initializing bsf");
+  }
+}
+
+BitstreamFilter::BitstreamFilter(BitstreamFilter&& rhs) noexcept
+    : ctx_(rhs.ctx_)
+{
+  rhs.ctx_ = nullptr;
+}
+
+BitstreamFilter& BitstreamFilter::operator=(BitstreamFilter&& rhs) noexcept {
+  if (this != &rhs) {
+    close();
+    ctx_ = rhs.ctx_;
+    rhs.ctx_ = nullptr;
+  }
+  return *this;
+}
+
+BitstreamFilter::~BitstreamFilter() {
+  close();
+}
+
+int BitstreamFilter::send_packet(AVPacket* pkt) {
+  return av_bsf_send_packet(ctx_, pkt);
+}
+
+int BitstreamFilter::receive_packet(AVPacket* pkt) {
+  return av_bsf_receive_packet(ctx_, pkt);
+}
+
+void BitstreamFilter::close() {
+  av_bsf_free(&ctx_);
+}
@@ -0,0 +1,52 @@
+//
+//  bsf.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+extern "C" {
+#include <libavcodec/bsf.h>
+}
+
+namespace av {
+
+namespace ffmpeg {
+
+class BitstreamFilter {
+ public:
+  BitstreamFilter(const BitstreamFilter&) = delete;
+  BitstreamFilter& operator=(const BitstreamFilter&) = delete;
+
+  // name = nullptr gives the pass-through "null" filter
+  BitstreamFilter(const char* name, const AVCodecParameters* par, AVRational time_base);
+
+  BitstreamFilter(BitstreamFilter&& rhs) noexcept;
+
+  BitstreamFilter& operator=(BitstreamFilter&& rhs) noexcept;
+
+  virtual ~BitstreamFilter();
+
+  // takes over the packet's reference, pkt = nullptr flushes
+  int send_packet(AVPacket* pkt);
+
+  int receive_packet(AVPacket* pkt);
+
+  inline const AVCodecParameters* par_out() const { return ctx_->par_out; }
+
+  inline AVRational time_base_out() const { return ctx_->time_base_out; }
+
+  inline AVBSFContext* ctx() { return ctx_; }
+
+ protected:
+  void close();
+
+ private:
+  AVBSFContext* ctx_ = nullptr;
+};
+
+} // ffmpeg
+
+} // av
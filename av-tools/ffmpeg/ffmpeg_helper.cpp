@@ -31,6 +31,39 @@ EncodeHelper::EncodeHelper(const char* codec_name, packet_callback&& pkt_cb)
   }
 }
 
+DecodeHelper::DecodeHelper(enum AVCodecID codec_id, frame_callback&& frame_cb)
+    : decoder_(codec_id),
+      frame_(av_frame_alloc(), &frame_deleter),
+      frame_cb_(std::move(frame_cb))
+{
+  if (!frame_) {
+    throw std::runtime_error("DecodeHelper: Cannot allocate memory");
+  }
+}
+
+DecodeHelper::DecodeHelper(const char* codec_name, frame_callback&& frame_cb)
+    : decoder_(codec_name),
+      frame_(av_frame_alloc(), &frame_deleter),
+      frame_cb_(std::move(frame_cb))
+{
+  if (!frame_) {
+    throw std::runtime_error("DecodeHelper: Cannot allocate memory");
+  }
+}
+
+DecodeHelper::DecodeHelper(const AVStream* st, frame_callback&& frame_cb,
+                           int thread_count, int thread_type)
+    : DecodeHelper(st->codecpar->codec_id, std::move(frame_cb))
+{
+  if (decoder_.set_parameters(st->codecpar, st->time_base) < 0) {
+    throw std::runtime_error("DecodeHelper: error copying codecpar");
+  }
+  decoder_.set_threads(thread_count, thread_type);
+  if (decoder_.open() < 0) {
+    throw std::runtime_error("DecodeHelper: error opening decoder");
+  }
+}
+
 int EncodeHelper::encode(const AVFrame* frame) {
   int rc = encoder_.send_frame(frame);
   if (rc < 0) {
@@ -50,3 +83,66 @@ int EncodeHelper::encode(const AVFrame* frame) {
 
   return rc;
 }
+
+int DecodeHelper::decode(const AVPacket* pkt) {
+  int rc = decoder_.send_packet(pkt);
+  if (rc < 0) {
+    return rc;
+  }
+
+  for (;;) {
+    rc = decoder_.receive_frame(frame_.get());
+    if (rc < 0) {
+      if ((rc == AVERROR(EAGAIN)) || (rc == AVERROR_EOF)) {
+        rc = 0;
+      }
+      break;
+    }
+    frame_cb_(frame_.get());
+    av_frame_unref(frame_.get());
+  }
+
+  return rc;
+}
+
+int av::ffmpeg::demux_decode(Demuxer& demuxer, const std::vector<DecodeHelper*>& decoders) {
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt(av_packet_alloc(), &pkt_deleter);
+  if (!pkt) {
+    return AVERROR(ENOMEM);
+  }
+
+  int rc = 0;
+  for (;;) {
+    rc = demuxer.read_frame(pkt.get());
+    if (rc < 0) {
+      if (rc == AVERROR_EOF) {
+        rc = 0;
+      }
+      break;
+    }
+
+    size_t idx = pkt->stream_index;
+    if (idx < decoders.size() && decoders[idx]) {
+      // a corrupt packet is not fatal, the decoder resyncs on the next one
+      int err = decoders[idx]->decode(pkt.get());
+      if (err < 0 && err != AVERROR_INVALIDDATA) {
+        rc = err;
+      }
+    }
+    av_packet_unref(pkt.get());
+    if (rc < 0) {
+      return rc;
+    }
+  }
+  if (rc < 0) {
+    return rc;
+  }
+
+  for (DecodeHelper* helper : decoders) {
+    if (helper && (rc = helper->decode(nullptr)) < 0) {
+      return rc;
+    }
+  }
+
+  return 0;
+}
@@ -9,6 +9,8 @@
 
 #include <functional>
 #include <memory>
+#include <stdexcept>
+#include <vector>
 #include "av-tools/ffmpeg/avcodec.hpp"
 #include "av-tools/ffmpeg/avformat.hpp"
 #include "av-tools/ffmpeg/swresample.hpp"
@@ -42,6 +44,18 @@ struct ChannelLayoutHelper {
     av_channel_layout_default(&layout_, ac);
   }
 
+  // an AV_CH_* mask, 0 for the default layout of ac
+  ChannelLayoutHelper(int ac, uint64_t mask) {
+    if (!mask) {
+      av_channel_layout_default(&layout_, ac);
+      return;
+    }
+    if (av_channel_layout_from_mask(&layout_, mask) < 0 || layout_.nb_channels != ac) {
+      av_channel_layout_uninit(&layout_);
+      throw std::invalid_argument("ChannelLayoutHelper: mask does not match channel count");
+    }
+  }
+
   ~ChannelLayoutHelper() {
     av_channel_layout_uninit(&layout_);
   }
@@ -67,6 +81,31 @@ struct EncodeHelper {
   packet_callback pkt_cb_;
 };
 
+struct DecodeHelper {
+  using frame_callback = std::function<void(AVFrame*)>;
+
+  DecodeHelper(enum AVCodecID codec_id, frame_callback&& frame_cb);
+
+  DecodeHelper(const char* codec_name, frame_callback&& frame_cb);
+
+  // picks the decoder of st, copies its parameters and opens it
+  DecodeHelper(const AVStream* st, frame_callback&& frame_cb,
+               int thread_count = 0, int thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+  ~DecodeHelper() = default;
+
+  // pkt = nullptr drains the decoder
+  int decode(const AVPacket* pkt);
+
+  Decoder decoder_;
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> frame_;
+  frame_callback frame_cb_;
+};
+
+// Reads demuxer until EOF, feeding each packet to decoders[stream_index]
+// (streams without a decoder are skipped), then drains every decoder.
+int demux_decode(Demuxer& demuxer, const std::vector<DecodeHelper*>& decoders);
+
 } // ffmpeg
 
 } // av
@@ -0,0 +1,81 @@
+//
+//  frame_pool.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include <stdexcept>
+#include "av-tools/ffmpeg/frame_pool.hpp"
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+using namespace av::ffmpeg;
+
+AudioFramePool::AudioFramePool(enum AVSampleFormat sample_fmt, const AVChannelLayout& ch_layout, int nb_samples)
+    : sample_fmt_(sample_fmt),
+      nb_samples_(nb_samples)
+{
+  if (nb_samples <= 0) {
+    throw std::invalid_argument("AudioFramePool: invalid nb_samples");
+  }
+
+  if (av_channel_layout_copy(&ch_layout_, &ch_layout) < 0) {
+    throw std::runtime_error("AudioFramePool: error copying ch_layout");
+  }
+
+  nb_planes_ = av_sample_fmt_is_planar(sample_fmt) ? ch_layout.nb_channels : 1;
+  if (nb_planes_ > AV_NUM_DATA_POINTERS) {
+    av_channel_layout_uninit(&ch_layout_);
+    throw std::invalid_argument("AudioFramePool: too many planes");
+  }
+
+  // one pool buffer per plane, linesize is the size of a single plane
+  if (av_samples_get_buffer_size(&linesize_, ch_layout.nb_channels, nb_samples, sample_fmt, 0) < 0) {
+    av_channel_layout_uninit(&ch_layout_);
+    throw std::runtime_error("AudioFramePool: error getting buffer size");
+  }
+
+  pool_ = av_buffer_pool_init2(linesize_, this, &AudioFramePool::alloc, nullptr);
+  if (!pool_) {
+    av_channel_layout_uninit(&ch_layout_);
+    throw std::runtime_error("AudioFramePool: Cannot allocate memory");
+  }
+}
+
+AudioFramePool::~AudioFramePool() {
+  // buffers still referenced elsewhere keep the pool alive until released
+  av_buffer_pool_uninit(&pool_);
+  av_channel_layout_uninit(&ch_layout_);
+}
+
+int AudioFramePool::get(AVFrame* frame) {
+  av_frame_unref(frame);
+
+  int rc = av_channel_layout_copy(&frame->ch_layout, &ch_layout_);
+  if (rc < 0) {
+    return rc;
+  }
+  frame->format = sample_fmt_;
+  frame->nb_samples = nb_samples_;
+
+  for (int i = 0; i != nb_planes_; ++i) {
+    frame->buf[i] = av_buffer_pool_get(pool_);
+    if (!frame->buf[i]) {
+      av_frame_unref(frame);
+      return AVERROR(ENOMEM);
+    }
+    frame->data[i] = frame->buf[i]->data;
+  }
+  frame->linesize[0] = linesize_;
+  frame->extended_data = frame->data;
+
+  return 0;
+}
+
+AVBufferRef* AudioFramePool::alloc(void* opaque, size_t size) {
+  static_cast<AudioFramePool*>(opaque)->allocations_.fetch_add(1, std::memory_order_relaxed);
+  return av_buffer_alloc(size);
+}
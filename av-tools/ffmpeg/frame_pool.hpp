@@ -0,0 +1,56 @@
+//
+//  frame_pool.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+namespace av {
+
+namespace ffmpeg {
+
+// Hands out audio frames backed by an AVBufferPool. A buffer goes back to
+// the pool once the last reference (ours or the encoder's) is dropped.
+class AudioFramePool {
+ public:
+  AudioFramePool(const AudioFramePool&) = delete;
+  AudioFramePool& operator=(const AudioFramePool&) = delete;
+
+  explicit AudioFramePool(enum AVSampleFormat sample_fmt, const AVChannelLayout& ch_layout, int nb_samples);
+
+  virtual ~AudioFramePool();
+
+  // unrefs frame and attaches pooled buffers to it, the AVFrame itself is reused
+  int get(AVFrame* frame);
+
+  inline int nb_samples() const { return nb_samples_; }
+
+  // buffers allocated so far, stays flat once the pool is warm
+  inline uint64_t allocations() const { return allocations_.load(std::memory_order_relaxed); }
+
+ protected:
+  static AVBufferRef* alloc(void* opaque, size_t size);
+
+ private:
+  enum AVSampleFormat sample_fmt_;
+  AVChannelLayout ch_layout_{};
+  int nb_samples_;
+  int nb_planes_ = 0;
+  int linesize_ = 0;
+  AVBufferPool* pool_ = nullptr;
+  std::atomic<uint64_t> allocations_{0};
+};
+
+} // ffmpeg
+
+} // av
@@ -0,0 +1,122 @@
+//
+//  frame_queue.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include <stdexcept>
+#include "av-tools/ffmpeg/frame_queue.hpp"
+
+using namespace av::ffmpeg;
+
+FrameQueue::FrameQueue(std::size_t max_frames)
+    : max_frames_(max_frames)
+{
+  if (!max_frames) {
+    throw std::invalid_argument("FrameQueue: invalid argument");
+  }
+}
+
+FrameQueue::~FrameQueue() {
+  clear();
+}
+
+bool FrameQueue::push(const AVFrame* frame) {
+  std::unique_lock<std::mutex> lk(mtx_);
+
+  not_full_.wait(lk, [this] { return closed_ || q_.size() < max_frames_; });
+
+  if (closed_) {
+    return false;
+  }
+
+  AVFrame* ref = av_frame_clone(frame);
+  if (!ref) {
+    throw std::runtime_error("FrameQueue: Cannot allocate memory");
+  }
+  q_.push_back(ref);
+
+  lk.unlock();
+  not_empty_.notify_one();
+
+  return true;
+}
+
+bool FrameQueue::pop(AVFrame* frame) {
+  std::unique_lock<std::mutex> lk(mtx_);
+
+  not_empty_.wait(lk, [this] { return closed_ || !q_.empty(); });
+
+  if (q_.empty()) {
+    return false;
+  }
+
+  AVFrame* front = q_.front();
+  q_.pop_front();
+  av_frame_move_ref(frame, front);
+  av_frame_free(&front);
+
+  lk.unlock();
+  not_full_.notify_one();
+
+  return true;
+}
+
+bool FrameQueue::try_push(const AVFrame* frame) {
+  std::unique_lock<std::mutex> lk(mtx_);
+
+  if (closed_ || q_.size() >= max_frames_) {
+    return false;
+  }
+
+  AVFrame* ref = av_frame_clone(frame);
+  if (!ref) {
+    throw std::runtime_error("FrameQueue: Cannot allocate memory");
+  }
+  q_.push_back(ref);
+
+  lk.unlock();
+  not_empty_.notify_one();
+
+  return true;
+}
+
+bool FrameQueue::try_pop(AVFrame* frame) {
+  std::unique_lock<std::mutex> lk(mtx_);
+
+  if (q_.empty()) {
+    return false;
+  }
+
+  AVFrame* front = q_.front();
+  q_.pop_front();
+  av_frame_move_ref(frame, front);
+  av_frame_free(&front);
+
+  lk.unlock();
+  not_full_.notify_one();
+
+  return true;
+}
+
+void FrameQueue::close() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    closed_ = true;
+  }
+  not_empty_.notify_all();
+  not_full_.notify_all();
+}
+
+std::size_t FrameQueue::size() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return q_.size();
+}
+
+void FrameQueue::clear() {
+  for (AVFrame* frame : q_) {
+    av_frame_free(&frame);
+  }
+  q_.clear();
+}
@@ -0,0 +1,65 @@
+//
+//  frame_queue.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+namespace av {
+
+namespace ffmpeg {
+
+// Bounded, thread-safe queue of refcounted frames, push() waits for room
+// and try_push() does not.
+class FrameQueue {
+ public:
+  FrameQueue(const FrameQueue&) = delete;
+  FrameQueue& operator=(const FrameQueue&) = delete;
+
+  explicit FrameQueue(std::size_t max_frames);
+
+  virtual ~FrameQueue();
+
+  // takes a new reference to frame, returns false once the queue is closed
+  bool push(const AVFrame* frame);
+
+  // moves the front frame into frame, blocks while empty,
+  // returns false once the queue is closed and drained
+  bool pop(AVFrame* frame);
+
+  // never waits, returns false if the queue is full or closed
+  bool try_push(const AVFrame* frame);
+
+  // never waits, returns false if the queue is empty
+  bool try_pop(AVFrame* frame);
+
+  void close();
+
+  std::size_t size() const;
+
+ protected:
+  void clear();
+
+ private:
+  const std::size_t max_frames_;
+  mutable std::mutex mtx_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<AVFrame*> q_;
+  bool closed_ = false;
+};
+
+} // ffmpeg
+
+} // av
@@ -0,0 +1,159 @@
+//
+//  packet_queue.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include <algorithm>
+#include <stdexcept>
+#include "av-tools/ffmpeg/packet_queue.hpp"
+
+using namespace av::ffmpeg;
+
+PacketQueue::PacketQueue(std::size_t max_packets, Policy policy)
+    : max_packets_(max_packets),
+      policy_(policy)
+{
+  if (!max_packets) {
+    throw std::invalid_argument("PacketQueue: invalid argument");
+  }
+}
+
+PacketQueue::~PacketQueue() {
+  clear();
+}
+
+bool PacketQueue::push(const AVPacket* pkt) {
+  std::unique_lock<std::mutex> lk(mtx_);
+
+  if (policy_ == Policy::block) {
+    not_full_.wait(lk, [this] { return closed_ || q_.size() < max_packets_; });
+  }
+
+  if (closed_) {
+    return false;
+  }
+
+  std::size_t idx = pkt->stream_index;
+  if (idx >= wait_key_.size()) {
+    wait_key_.resize(idx + 1, false);
+  }
+
+  if (wait_key_[idx]) {
+    if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    wait_key_[idx] = false;
+  }
+
+  if (q_.size() >= max_packets_) {
+    if (policy_ == Policy::drop_oldest) {
+      drop_front();
+    } else {
+      dropped_.fetch_add(q_.size(), std::memory_order_relaxed);
+      clear();
+      wait_key_.assign(wait_key_.size(), true);
+      if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      wait_key_[idx] = false;
+    }
+  }
+
+  AVPacket* ref = av_packet_clone(pkt);
+  if (!ref) {
+    throw std::runtime_error("PacketQueue: Cannot allocate memory");
+  }
+  q_.push_back(ref);
+
+  lk.unlock();
+  not_empty_.notify_one();
+
+  return true;
+}
+
+bool PacketQueue::pop(AVPacket* pkt) {
+  std::unique_lock<std::mutex> lk(mtx_);
+
+  not_empty_.wait(lk, [this] { return closed_ || !q_.empty(); });
+
+  if (q_.empty()) {
+    return false;
+  }
+
+  AVPacket* front = q_.front();
+  q_.pop_front();
+  av_packet_move_ref(pkt, front);
+  av_packet_free(&front);
+
+  lk.unlock();
+  not_full_.notify_one();
+
+  return true;
+}
+
+bool PacketQueue::try_pop(AVPacket* pkt) {
+  std::unique_lock<std::mutex> lk(mtx_);
+
+  if (q_.empty()) {
+    return false;
+  }
+
+  AVPacket* front = q_.front();
+  q_.pop_front();
+  av_packet_move_ref(pkt, front);
+  av_packet_free(&front);
+
+  lk.unlock();
+  not_full_.notify_one();
+
+  return true;
+}
+
+void PacketQueue::close() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    closed_ = true;
+  }
+  not_empty_.notify_all();
+  not_full_.notify_all();
+}
+
+void PacketQueue::abort() {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    closed_ = true;
+    dropped_.fetch_add(q_.size(), std::memory_order_relaxed);
+    clear();
+  }
+  not_empty_.notify_all();
+  not_full_.notify_all();
+}
+
+void PacketQueue::skip_until_keyframe(std::size_t nb_streams) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  wait_key_.assign(std::max(nb_streams, wait_key_.size()), false);
+  std::fill_n(wait_key_.begin(), nb_streams, true);
+}
+
+std::size_t PacketQueue::size() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return q_.size();
+}
+
+void PacketQueue::drop_front() {
+  AVPacket* front = q_.front();
+  q_.pop_front();
+  av_packet_free(&front);
+  dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PacketQueue::clear() {
+  for (AVPacket* pkt : q_) {
+    av_packet_free(&pkt);
+  }
+  q_.clear();
+}
@@ -0,0 +1,82 @@
+//
+//  packet_queue.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace av {
+
+namespace ffmpeg {
+
+// Bounded, thread-safe queue of refcounted packets.
+class PacketQueue {
+ public:
+  enum class Policy {
+    block,                // push() waits for room
+    drop_oldest,          // the oldest packet is dropped
+    drop_until_keyframe,  // the queue is flushed and each stream skips to its next keyframe
+  };
+
+  PacketQueue(const PacketQueue&) = delete;
+  PacketQueue& operator=(const PacketQueue&) = delete;
+
+  explicit PacketQueue(std::size_t max_packets, Policy policy = Policy::block);
+
+  virtual ~PacketQueue();
+
+  // takes a new reference to pkt, returns false once the queue is closed
+  bool push(const AVPacket* pkt);
+
+  // moves the front packet into pkt, blocks while empty,
+  // returns false once the queue is closed and drained
+  bool pop(AVPacket* pkt);
+
+  // never waits, returns false if the queue is empty
+  bool try_pop(AVPacket* pkt);
+
+  void close();
+
+  // closes the queue and drops what is still queued, counting it as dropped
+  void abort();
+
+  // drops non-key packets of streams [0, nb_streams) until their next keyframe
+  void skip_until_keyframe(std::size_t nb_streams);
+
+  std::size_t size() const;
+
+  inline uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ protected:
+  void drop_front();
+  void clear();
+
+ private:
+  const std::size_t max_packets_;
+  const Policy policy_;
+  mutable std::mutex mtx_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<AVPacket*> q_;
+  std::vector<bool> wait_key_;
+  bool closed_ = false;
+  std::atomic<uint64_t> dropped_{0};
+};
+
+} // ffmpeg
+
+} // av
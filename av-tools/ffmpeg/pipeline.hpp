@@ -0,0 +1,254 @@
+//
+//  pipeline.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "av-tools/ffmpeg/avcodec.hpp"
+#include "av-tools/ffmpeg/avformat.hpp"
+#include "av-tools/ffmpeg/ffmpeg_helper.hpp"
+#include "av-tools/ffmpeg/frame_pool.hpp"
+#include "av-tools/ffmpeg/swresample.hpp"
+
+namespace av {
+
+namespace ffmpeg {
+
+// Compile-time composed stages. Each stage owns the next one by value and
+// calls it directly, so unlike EncodeHelper's std::function the hops can be
+// inlined:
+//
+//   DecodeStage pipe(decoder,
+//                    ResampleStage(resampler, pool,
+//                                  EncodeStage(encoder,
+//                                              MuxSink(muxer, 0, encoder.ctx()->time_base))));
+//   pipe(pkt);
+//
+// Any callable taking AVFrame*/AVPacket* and returning int (or void) is a sink.
+// The stages only borrow the wrappers, which stay the runtime option.
+
+template <typename Next, typename Arg>
+inline int call_next(Next& next, Arg arg) {
+  if constexpr (std::is_void_v<std::invoke_result_t<Next&, Arg>>) {
+    next(arg);
+    return 0;
+  } else {
+    return next(arg);
+  }
+}
+
+template <typename Next>
+class DecodeStage {
+ public:
+  DecodeStage(Decoder& decoder, Next next)
+      : decoder_(decoder),
+        next_(std::move(next)),
+        frame_(av_frame_alloc(), &frame_deleter)
+  {
+    if (!frame_) {
+      throw std::runtime_error("DecodeStage: Cannot allocate memory");
+    }
+  }
+
+  // pkt = nullptr drains the decoder
+  int operator()(const AVPacket* pkt) {
+    int rc = decoder_.send_packet(pkt);
+    if (rc < 0) {
+      return rc;
+    }
+
+    for (;;) {
+      rc = decoder_.receive_frame(frame_.get());
+      if (rc < 0) {
+        if ((rc == AVERROR(EAGAIN)) || (rc == AVERROR_EOF)) {
+          rc = 0;
+        }
+        break;
+      }
+      rc = call_next(next_, frame_.get());
+      av_frame_unref(frame_.get());
+      if (rc < 0) {
+        break;
+      }
+    }
+
+    return rc;
+  }
+
+  inline Next& next() { return next_; }
+
+ private:
+  Decoder& decoder_;
+  Next next_;
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> frame_;
+};
+
+template <typename Next>
+class ResampleStage {
+ public:
+  // frames are sized by pool, pts counts samples from 0 unless sync_timestamps()
+  ResampleStage(Resampler& resampler, AudioFramePool& pool, Next next)
+      : resampler_(resampler),
+        pool_(pool),
+        next_(std::move(next)),
+        frame_(av_frame_alloc(), &frame_deleter)
+  {
+    if (!frame_) {
+      throw std::runtime_error("ResampleStage: Cannot allocate memory");
+    }
+  }
+
+  int operator()(const uint8_t* const* data, int nb_samples) {
+    return convert(data, nb_samples);
+  }
+
+  // a decoded frame, e.g. from DecodeStage
+  int operator()(const AVFrame* frame) {
+    if (in_tb_.num && frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+      // where the frame's first sample belongs, in output samples
+      int64_t ts = av_rescale_q(frame->best_effort_timestamp, in_tb_, out_tb_);
+      if (!synced_ || ts - (pts_ + filled_) > pool_.nb_samples()) {
+        pts_ = ts - filled_;
+        synced_ = true;
+      }
+    }
+    return convert(frame->extended_data, frame->nb_samples);
+  }
+
+  // Frames passed as AVFrame* then set pts: the first one starts it at its
+  // best_effort_timestamp (in in_tb), and a gap of more than a frame moves it
+  // forward. Overlaps are not undone, so pts never goes back.
+  void sync_timestamps(AVRational in_tb, int out_sample_rate) {
+    in_tb_ = in_tb;
+    out_tb_ = av_make_q(1, out_sample_rate);
+  }
+
+  // drains swr and passes on the last, partial frame
+  int flush() {
+    return convert(nullptr, 0);
+  }
+
+  inline Next& next() { return next_; }
+
+ private:
+  int convert(const uint8_t* const* data, int nb_samples) {
+    for (;;) {
+      if (!filled_ && pool_.get(frame_.get()) < 0) {
+        return AVERROR(ENOMEM);
+      }
+
+      int rc = resampler_.resample(data, nb_samples, frame_.get(), filled_);
+      if (rc < 0) {
+        return rc;
+      }
+      nb_samples = 0;
+      filled_ += rc;
+
+      if (filled_ < frame_->nb_samples) {
+        if (data || !filled_) {
+          break;
+        }
+        if (rc) {
+          continue;
+        }
+        frame_->nb_samples = filled_;
+      }
+
+      frame_->pts = pts_;
+      pts_ += frame_->nb_samples;
+      filled_ = 0;
+      if ((rc = call_next(next_, static_cast<const AVFrame*>(frame_.get()))) < 0) {
+        return rc;
+      }
+    }
+
+    return 0;
+  }
+
+  Resampler& resampler_;
+  AudioFramePool& pool_;
+  Next next_;
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> frame_;
+  int filled_ = 0;
+  int64_t pts_ = 0;
+  AVRational in_tb_{0, 1};
+  AVRational out_tb_{0, 1};
+  bool synced_ = false;
+};
+
+template <typename Next>
+class EncodeStage {
+ public:
+  EncodeStage(Encoder& encoder, Next next)
+      : encoder_(encoder),
+        next_(std::move(next)),
+        pkt_(av_packet_alloc(), &pkt_deleter)
+  {
+    if (!pkt_) {
+      throw std::runtime_error("EncodeStage: Cannot allocate memory");
+    }
+  }
+
+  // frame = nullptr drains the encoder
+  int operator()(const AVFrame* frame) {
+    int rc = encoder_.send_frame(frame);
+    if (rc < 0) {
+      return rc;
+    }
+
+    for (;;) {
+      rc = encoder_.receive_packet(pkt_.get());
+      if (rc < 0) {
+        if ((rc == AVERROR(EAGAIN)) || (rc == AVERROR_EOF)) {
+          rc = 0;
+        }
+        break;
+      }
+      rc = call_next(next_, pkt_.get());
+      av_packet_unref(pkt_.get());
+      if (rc < 0) {
+        break;
+      }
+    }
+
+    return rc;
+  }
+
+  inline Next& next() { return next_; }
+
+ private:
+  Encoder& encoder_;
+  Next next_;
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt_;
+};
+
+class MuxSink {
+ public:
+  // packets arrive in time_base, e.g. the encoder's
+  MuxSink(Muxer& muxer, int stream_index, AVRational time_base)
+      : muxer_(muxer),
+        stream_index_(stream_index),
+        time_base_(time_base) { }
+
+  int operator()(AVPacket* pkt) {
+    pkt->stream_index = stream_index_;
+    av_packet_rescale_ts(pkt, time_base_, muxer_.ctx()->streams[stream_index_]->time_base);
+    return muxer_.interleaved_write_frame(pkt);
+  }
+
+ private:
+  Muxer& muxer_;
+  int stream_index_;
+  AVRational time_base_;
+};
+
+} // ffmpeg
+
+} // av
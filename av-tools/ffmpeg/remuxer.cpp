@@ -0,0 +1,205 @@
+//
+//  remuxer.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include "av-tools/ffmpeg/remuxer.hpp"
+
+using namespace av::ffmpeg;
+
+namespace {
+
+// larger gaps are treated as a timestamp discontinuity, not waited out
+constexpr int64_t max_pace_us = 10 * 1000000;
+
+} // namespace
+
+Remuxer::Remuxer(const char* in_url, const char* out_url, const Options& opts)
+    : pkt_(av_packet_alloc(), &pkt_deleter),
+      realtime_(opts.realtime)
+{
+  if (!pkt_) {
+    throw std::runtime_error("Remuxer: Cannot allocate memory");
+  }
+
+  if (demuxer_.open(in_url) < 0) {
+    throw std::runtime_error("Remuxer: error opening input");
+  }
+  if (demuxer_.find_stream_info() < 0) {
+    throw std::runtime_error("Remuxer: error finding stream info");
+  }
+
+  const char* format = opts.format;
+  if (!format && out_url && !strncmp(out_url, "rtmp", 4)) {
+    format = "flv";
+  }
+  if (muxer_.open(out_url, format) < 0) {
+    throw std::runtime_error("Remuxer: error opening output");
+  }
+
+  AVFormatContext* ic = demuxer_.ctx();
+  streams_.resize(ic->nb_streams);
+
+  for (unsigned i = 0; i != ic->nb_streams; ++i) {
+    const AVStream* in_st = ic->streams[i];
+    const AVCodecParameters* par = in_st->codecpar;
+    const char* bsf = nullptr;
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+      bsf = opts.video_bsf;
+    } else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+      bsf = opts.audio_bsf;
+    } else {
+      continue;
+    }
+    if (!bsf && opts.auto_bsf) {
+      bsf = pick_bsf(par, muxer_.ctx()->oformat);
+    }
+
+    Stream& st = streams_[i];
+    st.bsf = std::make_unique<BitstreamFilter>(bsf, par, in_st->time_base);
+
+    AVStream* out_st = muxer_.new_stream();
+    if (!out_st) {
+      throw std::runtime_error("Remuxer: error creating stream");
+    }
+    if (avcodec_parameters_copy(out_st->codecpar, st.bsf->par_out()) < 0) {
+      throw std::runtime_error("Remuxer: error copying codecpar");
+    }
+    // the input container's tag rarely means anything to the output one
+    out_st->codecpar->codec_tag = 0;
+    out_st->time_base = st.bsf->time_base_out();
+    st.out_index = out_st->index;
+  }
+
+  if (muxer_.write_header() < 0) {
+    throw std::runtime_error("Remuxer: error writing header");
+  }
+}
+
+Remuxer::~Remuxer() = default;
+
+int Remuxer::run() {
+  int rc = 0;
+
+  while (!stop_.load(std::memory_order_relaxed)) {
+    rc = demuxer_.read_frame(pkt_.get());
+    if (rc < 0) {
+      if (rc == AVERROR_EOF) {
+        rc = 0;
+      }
+      break;
+    }
+
+    std::size_t idx = pkt_->stream_index;
+    if (idx >= streams_.size() || !streams_[idx].bsf) {
+      av_packet_unref(pkt_.get());
+      continue;
+    }
+
+    if (realtime_) {
+      pace(pkt_.get(), demuxer_.ctx()->streams[idx]->time_base);
+    }
+
+    rc = filter(streams_[idx], pkt_.get());
+    if (rc < 0) {
+      break;
+    }
+  }
+
+  if (rc < 0) {
+    return rc;
+  }
+
+  for (Stream& st : streams_) {
+    if (st.bsf && (rc = filter(st, nullptr)) < 0) {
+      return rc;
+    }
+  }
+
+  return 0;
+}
+
+// Recommends the filter the output container needs for a copied stream, or nullptr.
+const char* Remuxer::pick_bsf(const AVCodecParameters* par, const AVOutputFormat* ofmt) {
+  const char* name = ofmt->name;
+  bool annexb = !strcmp(name, "mpegts") || !strcmp(name, "h264") || !strcmp(name, "hevc");
+  // avcC/hvcC extradata starts with version 1, Annex B with a start code
+  bool length_prefixed = par->extradata_size > 0 && par->extradata[0] == 1;
+
+  switch (par->codec_id) {
+    case AV_CODEC_ID_H264:
+      return annexb && length_prefixed ? "h264_mp4toannexb" : nullptr;
+    case AV_CODEC_ID_HEVC:
+      return annexb && length_prefixed ? "hevc_mp4toannexb" : nullptr;
+    case AV_CODEC_ID_AAC:
+      // ADTS input carries no AudioSpecificConfig
+      return !annexb && strcmp(name, "adts") && !par->extradata_size ? "aac_adtstoasc" : nullptr;
+    default:
+      return nullptr;
+  }
+}
+
+// pkt = nullptr flushes the filter
+int Remuxer::filter(Stream& st, AVPacket* pkt) {
+  int rc = st.bsf->send_packet(pkt);
+  if (rc < 0) {
+    if (pkt) {
+      av_packet_unref(pkt);
+    }
+    return rc;
+  }
+
+  AVStream* out_st = muxer_.ctx()->streams[st.out_index];
+  for (;;) {
+    rc = st.bsf->receive_packet(pkt_.get());
+    if (rc < 0) {
+      if ((rc == AVERROR(EAGAIN)) || (rc == AVERROR_EOF)) {
+        rc = 0;
+      }
+      break;
+    }
+
+    pkt_->stream_index = st.out_index;
+    av_packet_rescale_ts(pkt_.get(), st.bsf->time_base_out(), out_st->time_base);
+    pkt_->pos = -1;
+    rc = muxer_.interleaved_write_frame(pkt_.get());
+    if (rc < 0) {
+      break;
+    }
+    packets_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return rc;
+}
+
+// sleeps until pkt is due, the first paced packet sets the wall clock origin
+void Remuxer::pace(const AVPacket* pkt, AVRational time_base) {
+  int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+  if (ts == AV_NOPTS_VALUE) {
+    return;
+  }
+
+  int64_t ts_us = av_rescale_q(ts, time_base, av_make_q(1, 1000000));
+  auto now = std::chrono::steady_clock::now();
+  if (start_ts_us_ == AV_NOPTS_VALUE) {
+    start_ = now;
+    start_ts_us_ = ts_us;
+    return;
+  }
+
+  int64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now - start_).count();
+  int64_t wait_us = ts_us - start_ts_us_ - elapsed_us;
+  if (wait_us > max_pace_us || ts_us < start_ts_us_) {
+    start_ = now;
+    start_ts_us_ = ts_us;
+    return;
+  }
+  if (wait_us > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+  }
+}
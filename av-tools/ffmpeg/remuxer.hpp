@@ -0,0 +1,74 @@
+//
+//  remuxer.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "av-tools/ffmpeg/avformat.hpp"
+#include "av-tools/ffmpeg/bsf.hpp"
+#include "av-tools/ffmpeg/ffmpeg_helper.hpp"
+
+namespace av {
+
+namespace ffmpeg {
+
+// Stream copy: packets go from the demuxer through a bitstream filter to the
+// muxer without being decoded. Only audio and video streams are kept.
+class Remuxer {
+ public:
+  struct Options {
+    const char* format = nullptr;     // guessed from the output url, flv for rtmp
+    bool realtime = false;            // pace packets by dts, for file-to-live restreaming
+    bool auto_bsf = true;             // h264/hevc_mp4toannexb and aac_adtstoasc where needed
+    const char* video_bsf = nullptr;  // overrides the automatic choice
+    const char* audio_bsf = nullptr;
+  };
+
+  Remuxer(const Remuxer&) = delete;
+  Remuxer& operator=(const Remuxer&) = delete;
+
+  Remuxer(const char* in_url, const char* out_url, const Options& opts);
+
+  virtual ~Remuxer();
+
+  // until EOF or stop(), returns 0 or the first error
+  int run();
+
+  inline void stop() { stop_.store(true, std::memory_order_relaxed); }
+
+  inline uint64_t packets() const { return packets_.load(std::memory_order_relaxed); }
+
+  static const char* pick_bsf(const AVCodecParameters* par, const AVOutputFormat* ofmt);
+
+ private:
+  struct Stream {
+    int out_index = -1;
+    std::unique_ptr<BitstreamFilter> bsf;
+  };
+
+  int filter(Stream& st, AVPacket* pkt);
+
+  void pace(const AVPacket* pkt, AVRational time_base);
+
+  Demuxer demuxer_;
+  Muxer muxer_;
+  std::vector<Stream> streams_;  // by input stream index
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt_;
+  const bool realtime_;
+  std::chrono::steady_clock::time_point start_;
+  int64_t start_ts_us_ = AV_NOPTS_VALUE;
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> packets_{0};
+};
+
+} // ffmpeg
+
+} // av
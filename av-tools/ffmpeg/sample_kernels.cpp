@@ -0,0 +1,246 @@
+//
+//  sample_kernels.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include "av-tools/ffmpeg/sample_kernels.hpp"
+
+// a * b + c must stay two roundings, like swresample's x86 mixers
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AV_TOOLS_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace av::ffmpeg;
+
+namespace {
+
+constexpr float s16_scale = 1.0f / 32768;
+
+void s16_to_flt_c(const int16_t* in, float* out, int n) {
+  for (int i = 0; i != n; ++i) {
+    out[i] = in[i] * s16_scale;
+  }
+}
+
+void s16_stereo_to_fltp_c(const int16_t* in, float* l, float* r, int n) {
+  for (int i = 0; i != n; ++i) {
+    l[i] = in[2 * i] * s16_scale;
+    r[i] = in[2 * i + 1] * s16_scale;
+  }
+}
+
+void s16_mono_to_stereo_c(const int16_t* in, float* l, float* r, float c, int n) {
+  for (int i = 0; i != n; ++i) {
+    float v = in[i] * s16_scale;
+    v = v * c;
+    l[i] = v;
+    r[i] = v;
+  }
+}
+
+void s16_stereo_to_mono_c(const int16_t* in, float* out, float c0, float c1, int n) {
+  for (int i = 0; i != n; ++i) {
+    float a = in[2 * i] * s16_scale;
+    a = a * c0;
+    float b = in[2 * i + 1] * s16_scale;
+    b = b * c1;
+    out[i] = a + b;
+  }
+}
+
+const SampleKernels scalar_kernels = {
+  "scalar",
+  s16_to_flt_c,
+  s16_stereo_to_fltp_c,
+  s16_mono_to_stereo_c,
+  s16_stereo_to_mono_c,
+};
+
+#ifdef AV_TOOLS_X86
+
+// 4 x int16 -> 4 x float, sign-extended
+__attribute__((target("sse2")))
+inline __m128 cvt_lo_sse2(__m128i v) {
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+__attribute__((target("sse2")))
+inline __m128 cvt_hi_sse2(__m128i v) {
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+}
+
+__attribute__((target("sse2")))
+void s16_to_flt_sse2(const int16_t* in, float* out, int n) {
+  const __m128 k = _mm_set1_ps(s16_scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm_storeu_ps(out + i, _mm_mul_ps(cvt_lo_sse2(v), k));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(cvt_hi_sse2(v), k));
+  }
+  s16_to_flt_c(in + i, out + i, n - i);
+}
+
+// 4 stereo frames as 32-bit lanes, L in the low half, R in the high half
+__attribute__((target("sse2")))
+inline __m128 left_sse2(__m128i v) {
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(v, 16), 16));
+}
+
+__attribute__((target("sse2")))
+inline __m128 right_sse2(__m128i v) {
+  return _mm_cvtepi32_ps(_mm_srai_epi32(v, 16));
+}
+
+__attribute__((target("sse2")))
+void s16_stereo_to_fltp_sse2(const int16_t* in, float* l, float* r, int n) {
+  const __m128 k = _mm_set1_ps(s16_scale);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+    _mm_storeu_ps(l + i, _mm_mul_ps(left_sse2(v), k));
+    _mm_storeu_ps(r + i, _mm_mul_ps(right_sse2(v), k));
+  }
+  s16_stereo_to_fltp_c(in + 2 * i, l + i, r + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void s16_mono_to_stereo_sse2(const int16_t* in, float* l, float* r, float c, int n) {
+  const __m128 k = _mm_set1_ps(s16_scale);
+  const __m128 vc = _mm_set1_ps(c);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    __m128 lo = _mm_mul_ps(_mm_mul_ps(cvt_lo_sse2(v), k), vc);
+    __m128 hi = _mm_mul_ps(_mm_mul_ps(cvt_hi_sse2(v), k), vc);
+    _mm_storeu_ps(l + i, lo);
+    _mm_storeu_ps(l + i + 4, hi);
+    _mm_storeu_ps(r + i, lo);
+    _mm_storeu_ps(r + i + 4, hi);
+  }
+  s16_mono_to_stereo_c(in + i, l + i, r + i, c, n - i);
+}
+
+__attribute__((target("sse2")))
+void s16_stereo_to_mono_sse2(const int16_t* in, float* out, float c0, float c1, int n) {
+  const __m128 k = _mm_set1_ps(s16_scale);
+  const __m128 vc0 = _mm_set1_ps(c0);
+  const __m128 vc1 = _mm_set1_ps(c1);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+    __m128 a = _mm_mul_ps(_mm_mul_ps(left_sse2(v), k), vc0);
+    __m128 b = _mm_mul_ps(_mm_mul_ps(right_sse2(v), k), vc1);
+    _mm_storeu_ps(out + i, _mm_add_ps(a, b));
+  }
+  s16_stereo_to_mono_c(in + 2 * i, out + i, c0, c1, n - i);
+}
+
+const SampleKernels sse2_kernels = {
+  "sse2",
+  s16_to_flt_sse2,
+  s16_stereo_to_fltp_sse2,
+  s16_mono_to_stereo_sse2,
+  s16_stereo_to_mono_sse2,
+};
+
+__attribute__((target("avx2")))
+void s16_to_flt_avx2(const int16_t* in, float* out, int n) {
+  const __m256 k = _mm256_set1_ps(s16_scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), k));
+  }
+  s16_to_flt_c(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline __m256 left_avx2(__m256i v) {
+  return _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16));
+}
+
+__attribute__((target("avx2")))
+inline __m256 right_avx2(__m256i v) {
+  return _mm256_cvtepi32_ps(_mm256_srai_epi32(v, 16));
+}
+
+__attribute__((target("avx2")))
+void s16_stereo_to_fltp_avx2(const int16_t* in, float* l, float* r, int n) {
+  const __m256 k = _mm256_set1_ps(s16_scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+    _mm256_storeu_ps(l + i, _mm256_mul_ps(left_avx2(v), k));
+    _mm256_storeu_ps(r + i, _mm256_mul_ps(right_avx2(v), k));
+  }
+  s16_stereo_to_fltp_c(in + 2 * i, l + i, r + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void s16_mono_to_stereo_avx2(const int16_t* in, float* l, float* r, float c, int n) {
+  const __m256 k = _mm256_set1_ps(s16_scale);
+  const __m256 vc = _mm256_set1_ps(c);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+    __m256 f = _mm256_mul_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v), k), vc);
+    _mm256_storeu_ps(l + i, f);
+    _mm256_storeu_ps(r + i, f);
+  }
+  s16_mono_to_stereo_c(in + i, l + i, r + i, c, n - i);
+}
+
+__attribute__((target("avx2")))
+void s16_stereo_to_mono_avx2(const int16_t* in, float* out, float c0, float c1, int n) {
+  const __m256 k = _mm256_set1_ps(s16_scale);
+  const __m256 vc0 = _mm256_set1_ps(c0);
+  const __m256 vc1 = _mm256_set1_ps(c1);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+    __m256 a = _mm256_mul_ps(_mm256_mul_ps(left_avx2(v), k), vc0);
+    __m256 b = _mm256_mul_ps(_mm256_mul_ps(right_avx2(v), k), vc1);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(a, b));
+  }
+  s16_stereo_to_mono_c(in + 2 * i, out + i, c0, c1, n - i);
+}
+
+const SampleKernels avx2_kernels = {
+  "avx2",
+  s16_to_flt_avx2,
+  s16_stereo_to_fltp_avx2,
+  s16_mono_to_stereo_avx2,
+  s16_stereo_to_mono_avx2,
+};
+
+#endif // AV_TOOLS_X86
+
+} // namespace
+
+const SampleKernels& av::ffmpeg::sample_kernels() {
+  static const SampleKernels& best = *available_sample_kernels().back();
+  return best;
+}
+
+std::vector<const SampleKernels*> av::ffmpeg::available_sample_kernels() {
+  std::vector<const SampleKernels*> kernels{&scalar_kernels};
+#ifdef AV_TOOLS_X86
+  if (__builtin_cpu_supports("sse2")) {
+    kernels.push_back(&sse2_kernels);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(&avx2_kernels);
+  }
+#endif
+  return kernels;
+}
@@ -0,0 +1,44 @@
+//
+//  sample_kernels.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace av {
+
+namespace ffmpeg {
+
+// S16 -> float kernels for same-rate conversions. Every variant computes
+// (in * (1 / 32768.f)) * coeff with the same float roundings swresample uses,
+// so the output is bit-exact with swr_convert.
+struct SampleKernels {
+  const char* name;  // "avx2", "sse2" or "scalar"
+
+  // out[i] = in[i] / 32768, n values
+  void (*s16_to_flt)(const int16_t* in, float* out, int n);
+
+  // interleaved stereo to two planes
+  void (*s16_stereo_to_fltp)(const int16_t* in, float* l, float* r, int n);
+
+  // l[i] = r[i] = in[i] / 32768 * c
+  void (*s16_mono_to_stereo)(const int16_t* in, float* l, float* r, float c, int n);
+
+  // out[i] = in[2i] / 32768 * c0 + in[2i + 1] / 32768 * c1
+  void (*s16_stereo_to_mono)(const int16_t* in, float* out, float c0, float c1, int n);
+};
+
+// the fastest variant this CPU supports, picked once
+const SampleKernels& sample_kernels();
+
+// every variant this CPU supports, scalar first
+std::vector<const SampleKernels*> available_sample_kernels();
+
+} // ffmpeg
+
+} // av
@@ -5,6 +5,8 @@
 //  Created by zhanwang-sky on 2025/3/5.
 //
 
+#include <climits>
+#include <cmath>
 #include <stdexcept>
 #include "av-tools/ffmpeg/swresample.hpp"
 
@@ -47,6 +49,8 @@ Resampler::Resampler(int in_sample_rate, const AVChannelLayout& in_ch_layout, en
     goto err_exit;
   }
 
+  set_kernels(&sample_kernels());
+
   return;
 
 err_exit:
@@ -62,8 +66,10 @@ Resampler::Resampler(Resampler&& rhs) noexcept
       in_ch_layout_(rhs.in_ch_layout_),
       out_ch_layout_(rhs.out_ch_layout_),
       swr_(rhs.swr_),
-      samples_buf_(rhs.samples_buf_),
-      samples_(rhs.samples_)
+      kernels_(rhs.kernels_),
+      fast_path_(rhs.fast_path_),
+      coeffs_{rhs.coeffs_[0], rhs.coeffs_[1]},
+      pending_(std::move(rhs.pending_))
 {
   rhs.reset();
 }
@@ -79,8 +85,11 @@ Resampler& Resampler::operator=(Resampler&& rhs) noexcept {
     in_ch_layout_ = rhs.in_ch_layout_;
     out_ch_layout_ = rhs.out_ch_layout_;
     swr_ = rhs.swr_;
-    samples_buf_ = rhs.samples_buf_;
-    samples_ = rhs.samples_;
+    kernels_ = rhs.kernels_;
+    fast_path_ = rhs.fast_path_;
+    coeffs_[0] = rhs.coeffs_[0];
+    coeffs_[1] = rhs.coeffs_[1];
+    pending_ = std::move(rhs.pending_);
 
     rhs.reset();
   }
@@ -92,69 +101,125 @@ Resampler::~Resampler() {
   clean();
 }
 
-int Resampler::resample(const uint8_t* const* in_samples_buf, int in_samples, AVAudioFifo* af) {
-  int out_samples = 0;
-  int rc = 0;
+int Resampler::resample(const uint8_t* const* in_samples_buf, int in_samples, AVFrame* frame, int offset) {
+  static constexpr int max_planes = 64;
+  uint8_t* out[max_planes];
+  int planes = 1;
+  int bps = av_get_bytes_per_sample(out_sample_fmt_);
 
-  out_samples = swr_get_out_samples(swr_, in_samples);
-  if (out_samples < 0) {
-    return out_samples;
+  if (av_sample_fmt_is_planar(out_sample_fmt_)) {
+    planes = out_ch_layout_.nb_channels;
+  } else {
+    bps *= out_ch_layout_.nb_channels;
   }
 
-  out_samples = FFMAX(out_samples, out_sample_rate_);
-
-  // realloc
-  if (samples_ < out_samples) {
-    if (samples_buf_) {
-      av_freep(&samples_buf_[0]);
-    }
+  if (planes > max_planes || offset > frame->nb_samples) {
+    return AVERROR(EINVAL);
   }
 
-  if (!samples_buf_ || !samples_buf_[0]) {
-    if (!samples_buf_) {
-      // first alloc
-      rc = av_samples_alloc_array_and_samples(&samples_buf_, nullptr,
-                                              out_ch_layout_.nb_channels,
-                                              out_samples, out_sample_fmt_,
-                                              0);
-    } else {
-      // realloc
-      rc = av_samples_alloc(&samples_buf_[0], nullptr,
-                            out_ch_layout_.nb_channels,
-                            out_samples, out_sample_fmt_,
-                            0);
+  if (fast_path_ != FastPath::none) {
+    int nb_channels = in_ch_layout_.nb_channels;
+    int room = frame->nb_samples - offset;
+    int done = FFMIN(static_cast<int>(pending_.size()) / nb_channels, room);
+    int n = FFMIN(in_samples, room - done);
+    const int16_t* in = in_samples > 0 ? reinterpret_cast<const int16_t*>(in_samples_buf[0]) : nullptr;
+
+    if (done > 0) {
+      convert(pending_.data(), done, frame->extended_data, offset);
+      pending_.erase(pending_.begin(), pending_.begin() + done * nb_channels);
     }
-    if (rc < 0) {
-      return rc;
+    if (n > 0) {
+      convert(in, n, frame->extended_data, offset + done);
     }
-    samples_ = out_samples;
+    if (n < in_samples) {
+      pending_.insert(pending_.end(), in + n * nb_channels, in + in_samples * nb_channels);
+    }
+
+    return done + n;
+  }
+
+  for (int i = 0; i != planes; ++i) {
+    out[i] = frame->extended_data[i] + offset * bps;
+  }
+
+  return swr_convert(swr_,
+                     out, frame->nb_samples - offset,
+                     in_samples_buf, in_samples);
+}
+
+void Resampler::set_kernels(const SampleKernels* kernels) {
+  int in_channels = in_ch_layout_.nb_channels;
+  int out_channels = out_ch_layout_.nb_channels;
+  bool planar = av_sample_fmt_is_planar(out_sample_fmt_);
+  double matrix[2][2]{};
+
+  kernels_ = kernels;
+  fast_path_ = FastPath::none;
+
+  if (!kernels
+      || in_sample_rate_ != out_sample_rate_
+      || in_sample_fmt_ != AV_SAMPLE_FMT_S16
+      || av_get_packed_sample_fmt(out_sample_fmt_) != AV_SAMPLE_FMT_FLT
+      || in_channels < 1 || in_channels > 2
+      || out_channels < 1 || out_channels > 2) {
+    return;
+  }
+
+  if (!av_channel_layout_compare(&in_ch_layout_, &out_ch_layout_)) {
+    fast_path_ = (planar && out_channels == 2) ? FastPath::split : FastPath::convert;
+    return;
   }
 
-  out_samples = swr_convert(swr_,
-                            samples_buf_, samples_,
-                            in_samples_buf, in_samples);
-  if (out_samples < 0) {
-    return out_samples;
+  if (in_channels == out_channels || (out_channels == 2 && !planar)) {
+    return;
   }
 
-  if (out_samples > 0) {
-    rc = av_audio_fifo_write(af,
-                             reinterpret_cast<void* const*>(samples_buf_),
-                             out_samples);
-    if (rc < 0) {
-      return rc;
+  // the coefficients swr would use with its default options, the internal format is FLTP
+  if (swr_build_matrix2(&in_ch_layout_, &out_ch_layout_,
+                        M_SQRT1_2, M_SQRT1_2, 0.0, INT_MAX, 1.0,
+                        &matrix[0][0], 2, AV_MATRIX_ENCODING_NONE, nullptr) < 0) {
+    return;
+  }
+
+  if (in_channels == 1) {
+    // swr duplicates a single input only when both outputs use the same coefficient
+    if (matrix[0][0] != matrix[1][0]) {
+      return;
     }
+    coeffs_[0] = static_cast<float>(matrix[0][0]);
+    fast_path_ = FastPath::upmix;
+  } else {
+    coeffs_[0] = static_cast<float>(matrix[0][0]);
+    coeffs_[1] = static_cast<float>(matrix[0][1]);
+    fast_path_ = FastPath::downmix;
   }
+}
 
-  return out_samples;
+void Resampler::convert(const int16_t* in, int nb_samples, uint8_t* const* out, int offset) {
+  auto plane = [&](int i) {
+    return reinterpret_cast<float*>(out[i]) + offset;
+  };
+
+  switch (fast_path_) {
+    case FastPath::convert:
+      kernels_->s16_to_flt(in, reinterpret_cast<float*>(out[0]) + offset * out_ch_layout_.nb_channels,
+                           nb_samples * out_ch_layout_.nb_channels);
+      break;
+    case FastPath::split:
+      kernels_->s16_stereo_to_fltp(in, plane(0), plane(1), nb_samples);
+      break;
+    case FastPath::upmix:
+      kernels_->s16_mono_to_stereo(in, plane(0), plane(1), coeffs_[0], nb_samples);
+      break;
+    case FastPath::downmix:
+      kernels_->s16_stereo_to_mono(in, plane(0), coeffs_[0], coeffs_[1], nb_samples);
+      break;
+    case FastPath::none:
+      break;
+  }
 }
 
 void Resampler::clean() {
-  samples_ = 0;
-  if (samples_buf_) {
-    av_freep(&samples_buf_[0]);
-  }
-  av_freep(&samples_buf_);
   swr_free(&swr_);
   av_channel_layout_uninit(&out_ch_layout_);
   av_channel_layout_uninit(&in_ch_layout_);
@@ -164,6 +229,7 @@ void Resampler::reset() {
   in_ch_layout_ = AV_CHANNEL_LAYOUT_MONO;
   out_ch_layout_ = AV_CHANNEL_LAYOUT_MONO;
   swr_ = nullptr;
-  samples_buf_ = nullptr;
-  samples_ = 0;
+  kernels_ = nullptr;
+  fast_path_ = FastPath::none;
+  pending_.clear();
 }
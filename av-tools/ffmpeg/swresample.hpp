@@ -7,10 +7,12 @@
 
 #pragma once
 
+#include <vector>
 extern "C" {
-#include <libavutil/audio_fifo.h>
+#include <libavutil/frame.h>
 #include <libswresample/swresample.h>
 }
+#include "av-tools/ffmpeg/sample_kernels.hpp"
 
 namespace av {
 
@@ -30,12 +32,34 @@ class Resampler {
 
   virtual ~Resampler();
 
-  int resample(const uint8_t* const* in_samples_buf, int in_samples, AVAudioFifo* af);
+  // Converts straight into frame, starting at sample offset. Input that does not fit is
+  // kept by swr, call again with in_samples = 0 (and a non-null buffer) to drain it.
+  int resample(const uint8_t* const* in_samples_buf, int in_samples, AVFrame* frame, int offset);
+
+  // Same-rate S16 to FLT/FLTP conversions of mono and stereo bypass swr and use
+  // these kernels, sample_kernels() by default. nullptr always uses swr.
+  // Call before the first resample.
+  void set_kernels(const SampleKernels* kernels);
+
+  inline const SampleKernels* kernels() const {
+    return fast_path_ != FastPath::none ? kernels_ : nullptr;
+  }
 
  protected:
   void clean();
   void reset();
 
+ private:
+  enum class FastPath {
+    none,
+    convert,  // same layout, packed or mono
+    split,    // stereo to FLTP stereo
+    upmix,    // mono to FLTP stereo
+    downmix,  // stereo to mono
+  };
+
+  void convert(const int16_t* in, int nb_samples, uint8_t* const* out, int offset);
+
  private:
   int in_sample_rate_;
   int out_sample_rate_;
@@ -44,8 +68,10 @@ class Resampler {
   AVChannelLayout in_ch_layout_{};
   AVChannelLayout out_ch_layout_{};
   struct SwrContext* swr_ = nullptr;
-  uint8_t** samples_buf_ = nullptr;
-  int samples_ = 0;
+  const SampleKernels* kernels_ = nullptr;
+  FastPath fast_path_ = FastPath::none;
+  float coeffs_[2]{};
+  std::vector<int16_t> pending_;  // interleaved input that did not fit the frame
 };
 
 } // ffmpeg
@@ -0,0 +1,378 @@
+//
+//  transcoder.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include "av-tools/ffmpeg/ffmpeg_helper.hpp"
+#include "av-tools/ffmpeg/frame_pool.hpp"
+#include "av-tools/ffmpeg/frame_queue.hpp"
+#include "av-tools/ffmpeg/pipeline.hpp"
+#include "av-tools/ffmpeg/transcoder.hpp"
+
+using namespace av::ffmpeg;
+
+struct Transcoder::Track {
+  explicit Track(std::size_t queue_size)
+      : packets(queue_size),
+        decoded(queue_size),
+        filtered(queue_size) { }
+
+  // hands resampled frames to the encode thread
+  struct FilteredSink {
+    FrameQueue& queue;
+
+    int operator()(const AVFrame* frame) {
+      return queue.push(frame) ? 0 : AVERROR_EXIT;
+    }
+  };
+
+  enum AVMediaType type = AVMEDIA_TYPE_UNKNOWN;
+  AVRational in_tb{0, 1};  // of the decoded frames' timestamps
+  int out_index = -1;
+  std::unique_ptr<DecodeHelper> decoder;
+  std::unique_ptr<EncodeHelper> encoder;
+  std::unique_ptr<Resampler> resampler;
+  std::unique_ptr<AudioFramePool> frame_pool;
+  PacketQueue packets;
+  FrameQueue decoded;
+  FrameQueue filtered;
+  std::unique_ptr<ResampleStage<FilteredSink>> resample;  // created with the resampler
+};
+
+Transcoder::Transcoder(const char* in_url, const char* out_url, const Options& opts) {
+  if (demuxer_.open(in_url) < 0) {
+    throw std::runtime_error("Transcoder: error opening input");
+  }
+  if (demuxer_.find_stream_info() < 0) {
+    throw std::runtime_error("Transcoder: error finding stream info");
+  }
+  if (muxer_.open(out_url, opts.format) < 0) {
+    throw std::runtime_error("Transcoder: error opening output");
+  }
+
+  AVFormatContext* ic = demuxer_.ctx();
+  in_tracks_.resize(ic->nb_streams, nullptr);
+
+  for (unsigned i = 0; i != ic->nb_streams; ++i) {
+    const AVStream* in_st = ic->streams[i];
+    enum AVMediaType type = in_st->codecpar->codec_type;
+    if (!(type == AVMEDIA_TYPE_AUDIO && opts.audio_codec) &&
+        !(type == AVMEDIA_TYPE_VIDEO && opts.video_codec)) {
+      continue;
+    }
+
+    auto track = std::make_unique<Track>(opts.queue_size);
+    Track* t = track.get();
+    track->type = type;
+    track->in_tb = in_st->time_base;
+    track->decoder = std::make_unique<DecodeHelper>(in_st,
+                                                    [t](AVFrame* frame) { t->decoded.push(frame); },
+                                                    opts.decode_threads);
+    track->encoder = std::make_unique<EncodeHelper>(type == AVMEDIA_TYPE_AUDIO ? opts.audio_codec : opts.video_codec,
+                                                    [this, t](AVPacket* pkt) {
+                                                      pkt->stream_index = t->out_index;
+                                                      mux_q_->push(pkt);
+                                                    });
+
+    AVCodecContext* enc_ctx = track->encoder->encoder_.ctx();
+    if (muxer_.ctx()->oformat->flags & AVFMT_GLOBALHEADER) {
+      enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    track->encoder->encoder_.set_threads(opts.encode_threads);
+
+    if (type == AVMEDIA_TYPE_AUDIO) {
+      setup_audio(*track, opts);
+    } else {
+      setup_video(*track, in_st, opts);
+    }
+
+    AVStream* out_st = muxer_.new_stream();
+    if (!out_st) {
+      throw std::runtime_error("Transcoder: error creating stream");
+    }
+    if (avcodec_parameters_from_context(out_st->codecpar, enc_ctx) < 0) {
+      throw std::runtime_error("Transcoder: error copying codecpar");
+    }
+    out_st->time_base = enc_ctx->time_base;
+    track->out_index = out_st->index;
+    enc_tbs_.push_back(enc_ctx->time_base);
+
+    in_tracks_[i] = t;
+    tracks_.push_back(std::move(track));
+  }
+
+  if (tracks_.empty()) {
+    throw std::runtime_error("Transcoder: no stream to transcode");
+  }
+
+  if (muxer_.write_header() < 0) {
+    throw std::runtime_error("Transcoder: error writing header");
+  }
+
+  mux_q_ = std::make_unique<PacketQueue>(opts.queue_size);
+}
+
+Transcoder::~Transcoder() = default;
+
+int Transcoder::run() {
+  std::vector<std::thread> threads;
+
+  encoders_left_.store(static_cast<int>(tracks_.size()), std::memory_order_relaxed);
+
+  threads.emplace_back(&Transcoder::demux_loop, this);
+  for (auto& track : tracks_) {
+    threads.emplace_back(&Transcoder::decode_loop, this, std::ref(*track));
+    threads.emplace_back(&Transcoder::filter_loop, this, std::ref(*track));
+    threads.emplace_back(&Transcoder::encode_loop, this, std::ref(*track));
+  }
+  threads.emplace_back(&Transcoder::mux_loop, this);
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  std::lock_guard<std::mutex> lk(err_mtx_);
+  return err_;
+}
+
+void Transcoder::setup_audio(Track& track, const Options& opts) {
+  Encoder& encoder = track.encoder->encoder_;
+  AVCodecContext* enc_ctx = encoder.ctx();
+  const AVCodecContext* dec_ctx = track.decoder->decoder_.ctx();
+
+  int sample_rate = opts.sample_rate > 0 ? opts.sample_rate : dec_ctx->sample_rate;
+  enc_ctx->bit_rate = opts.audio_bit_rate;
+  enc_ctx->sample_rate = sample_rate;
+  enc_ctx->time_base = av_make_q(1, sample_rate);
+  enc_ctx->sample_fmt = encoder.codec()->sample_fmts ? encoder.codec()->sample_fmts[0] : dec_ctx->sample_fmt;
+  if (opts.nb_channels > 0) {
+    av_channel_layout_default(&enc_ctx->ch_layout, opts.nb_channels);
+  } else if (av_channel_layout_copy(&enc_ctx->ch_layout, &dec_ctx->ch_layout) < 0) {
+    throw std::runtime_error("Transcoder: error copying ch_layout");
+  }
+  if (encoder.open() < 0) {
+    throw std::runtime_error("Transcoder: error opening audio encoder");
+  }
+
+  int frame_size = (enc_ctx->frame_size > 0 &&
+                    !(encoder.codec()->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE)) ?
+                   enc_ctx->frame_size : 1024;
+  track.frame_pool = std::make_unique<AudioFramePool>(enc_ctx->sample_fmt, enc_ctx->ch_layout, frame_size);
+}
+
+void Transcoder::setup_video(Track& track, const AVStream* in_st, const Options& opts) {
+  Encoder& encoder = track.encoder->encoder_;
+  AVCodecContext* enc_ctx = encoder.ctx();
+  const AVCodecContext* dec_ctx = track.decoder->decoder_.ctx();
+
+  // no scaler, the encoder takes the decoded frames as they are
+  enc_ctx->bit_rate = opts.video_bit_rate;
+  enc_ctx->width = dec_ctx->width;
+  enc_ctx->height = dec_ctx->height;
+  enc_ctx->pix_fmt = dec_ctx->pix_fmt;
+  enc_ctx->time_base = in_st->time_base;
+  AVRational frame_rate = in_st->avg_frame_rate.num ? in_st->avg_frame_rate : in_st->r_frame_rate;
+  if (frame_rate.num) {
+    enc_ctx->framerate = frame_rate;
+  }
+  if (encoder.open() < 0) {
+    throw std::runtime_error("Transcoder: error opening video encoder");
+  }
+}
+
+void Transcoder::demux_loop() {
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt(av_packet_alloc(), &pkt_deleter);
+  if (!pkt) {
+    abort(AVERROR(ENOMEM));
+  }
+
+  try {
+    while (pkt && !failed_.load(std::memory_order_acquire)) {
+      int rc = demuxer_.read_frame(pkt.get());
+      if (rc < 0) {
+        if (rc != AVERROR_EOF) {
+          abort(rc);
+        }
+        break;
+      }
+
+      std::size_t idx = pkt->stream_index;
+      if (idx < in_tracks_.size() && in_tracks_[idx]) {
+        in_tracks_[idx]->packets.push(pkt.get());
+      }
+      av_packet_unref(pkt.get());
+    }
+  } catch (...) {
+    abort(AVERROR(ENOMEM));
+  }
+
+  for (auto& track : tracks_) {
+    track->packets.close();
+  }
+}
+
+void Transcoder::decode_loop(Track& track) {
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt(av_packet_alloc(), &pkt_deleter);
+  if (!pkt) {
+    abort(AVERROR(ENOMEM));
+  }
+
+  try {
+    while (pkt && track.packets.pop(pkt.get())) {
+      if (failed_.load(std::memory_order_acquire)) {
+        break;
+      }
+      // a corrupt packet is not fatal, the decoder resyncs on the next one
+      int rc = track.decoder->decode(pkt.get());
+      av_packet_unref(pkt.get());
+      if (rc < 0 && rc != AVERROR_INVALIDDATA) {
+        abort(rc);
+        break;
+      }
+    }
+
+    if (!failed_.load(std::memory_order_acquire)) {
+      int rc = track.decoder->decode(nullptr);
+      if (rc < 0) {
+        abort(rc);
+      }
+    }
+  } catch (...) {
+    abort(AVERROR(ENOMEM));
+  }
+
+  track.decoded.close();
+}
+
+void Transcoder::filter_loop(Track& track) {
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> frame(av_frame_alloc(), &frame_deleter);
+  if (!frame) {
+    abort(AVERROR(ENOMEM));
+  }
+
+  try {
+    int rc = 0;
+    while (frame && track.decoded.pop(frame.get())) {
+      if (failed_.load(std::memory_order_acquire)) {
+        break;
+      }
+
+      if (track.type == AVMEDIA_TYPE_AUDIO) {
+        if (!track.resample) {
+          AVCodecContext* enc_ctx = track.encoder->encoder_.ctx();
+          track.resampler = std::make_unique<Resampler>(
+              frame->sample_rate, frame->ch_layout, static_cast<enum AVSampleFormat>(frame->format),
+              enc_ctx->sample_rate, enc_ctx->ch_layout, enc_ctx->sample_fmt);
+          track.resample = std::make_unique<ResampleStage<Track::FilteredSink>>(
+              *track.resampler, *track.frame_pool, Track::FilteredSink{track.filtered});
+          // keep audio on the input's timeline, like video
+          track.resample->sync_timestamps(track.in_tb, enc_ctx->sample_rate);
+        }
+        rc = (*track.resample)(frame.get());
+      } else {
+        // let the encoder place its own keyframes
+        frame->pts = frame->best_effort_timestamp;
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        track.filtered.push(frame.get());
+      }
+      av_frame_unref(frame.get());
+
+      if (rc < 0) {
+        abort(rc);
+        break;
+      }
+    }
+
+    if (track.resample && !failed_.load(std::memory_order_acquire)) {
+      rc = track.resample->flush();
+      if (rc < 0) {
+        abort(rc);
+      }
+    }
+  } catch (...) {
+    abort(AVERROR(EINVAL));
+  }
+
+  track.filtered.close();
+}
+
+void Transcoder::encode_loop(Track& track) {
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> frame(av_frame_alloc(), &frame_deleter);
+  if (!frame) {
+    abort(AVERROR(ENOMEM));
+  }
+
+  try {
+    while (frame && track.filtered.pop(frame.get())) {
+      if (failed_.load(std::memory_order_acquire)) {
+        break;
+      }
+      int rc = track.encoder->encode(frame.get());
+      av_frame_unref(frame.get());
+      if (rc < 0) {
+        abort(rc);
+        break;
+      }
+    }
+
+    if (!failed_.load(std::memory_order_acquire)) {
+      int rc = track.encoder->encode(nullptr);
+      if (rc < 0) {
+        abort(rc);
+      }
+    }
+  } catch (...) {
+    abort(AVERROR(ENOMEM));
+  }
+
+  // the last encoder out closes the mux queue
+  if (encoders_left_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    mux_q_->close();
+  }
+}
+
+void Transcoder::mux_loop() {
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt(av_packet_alloc(), &pkt_deleter);
+  if (!pkt) {
+    abort(AVERROR(ENOMEM));
+  }
+
+  while (pkt && mux_q_->pop(pkt.get())) {
+    if (failed_.load(std::memory_order_acquire)) {
+      av_packet_unref(pkt.get());
+      break;
+    }
+
+    AVStream* st = muxer_.ctx()->streams[pkt->stream_index];
+    av_packet_rescale_ts(pkt.get(), enc_tbs_[pkt->stream_index], st->time_base);
+    int rc = muxer_.interleaved_write_frame(pkt.get());
+    av_packet_unref(pkt.get());
+    if (rc < 0) {
+      abort(rc);
+      break;
+    }
+  }
+}
+
+// records the first error and closes every queue, so blocked stages wake up and exit
+void Transcoder::abort(int rc) {
+  {
+    std::lock_guard<std::mutex> lk(err_mtx_);
+    if (!err_) {
+      err_ = rc;
+    }
+  }
+  failed_.store(true, std::memory_order_release);
+
+  for (auto& track : tracks_) {
+    track->packets.close();
+    track->decoded.close();
+    track->filtered.close();
+  }
+  mux_q_->close();
+}
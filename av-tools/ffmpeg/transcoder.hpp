@@ -0,0 +1,79 @@
+//
+//  transcoder.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "av-tools/ffmpeg/avformat.hpp"
+#include "av-tools/ffmpeg/packet_queue.hpp"
+
+namespace av {
+
+namespace ffmpeg {
+
+// Demux -> decode -> resample -> encode -> mux, every stage on its own thread
+// (decode, resample and encode once per stream) with bounded queues between
+// them, so throughput is bound by the slowest stage.
+class Transcoder {
+ public:
+  struct Options {
+    const char* format = nullptr;          // guessed from the output url
+    const char* audio_codec = "aac";       // nullptr drops audio
+    const char* video_codec = "libx264";   // nullptr drops video, frames are not scaled
+    int sample_rate = 0;                   // 0 keeps the input's
+    int nb_channels = 0;
+    int64_t audio_bit_rate = 0;
+    int64_t video_bit_rate = 0;
+    int decode_threads = 0;                // codec threads, 0 for auto
+    int encode_threads = 0;
+    std::size_t queue_size = 64;           // packets/frames between two stages
+  };
+
+  Transcoder(const Transcoder&) = delete;
+  Transcoder& operator=(const Transcoder&) = delete;
+
+  Transcoder(const char* in_url, const char* out_url, const Options& opts);
+
+  virtual ~Transcoder();
+
+  // blocks until the input is fully transcoded, returns 0 or the first error
+  int run();
+
+ private:
+  struct Track;
+
+  void setup_audio(Track& track, const Options& opts);
+  void setup_video(Track& track, const AVStream* in_st, const Options& opts);
+
+  void demux_loop();
+  void decode_loop(Track& track);
+  void filter_loop(Track& track);
+  void encode_loop(Track& track);
+  void mux_loop();
+
+  void abort(int rc);
+
+  Demuxer demuxer_;
+  Muxer muxer_;
+  std::vector<std::unique_ptr<Track>> tracks_;
+  std::vector<Track*> in_tracks_;  // by input stream index
+  std::vector<AVRational> enc_tbs_;  // by output stream index
+  std::unique_ptr<PacketQueue> mux_q_;
+  std::atomic<int> encoders_left_{0};
+  std::mutex err_mtx_;
+  int err_ = 0;
+  std::atomic<bool> failed_{false};
+};
+
+} // ffmpeg
+
+} // av
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <fstream>
 #include <functional>
 #include <memory>
@@ -26,9 +27,9 @@
 
 class LiveStreamer {
  public:
-  LiveStreamer(const char* url, const char* ppm_path)
-      : streamer_(av_streamer_alloc(url, NB_CHANNELS, SAMPLE_RATE),
-                  &av_streamer_free),
+  // ppm_path, if set, also gets a snapshot of the 10th video frame
+  LiveStreamer(const char* url, const char* ppm_path = nullptr)
+      : streamer_(alloc_streamer(url), &av_streamer_free),
         media_capture_(NB_CHANNELS, SAMPLE_RATE,
                        VIDEO_WIDTH, VIDEO_HEIGHT, FRAME_RATE,
                        std::bind(&LiveStreamer::on_audio, this,
@@ -37,10 +38,16 @@ class LiveStreamer {
                        std::bind(&LiveStreamer::on_video, this,
                                  std::placeholders::_1,
                                  std::placeholders::_2)),
-        ppm_(ppm_path, std::fstream::binary | std::fstream::trunc)
+        start_time_(std::chrono::steady_clock::now())
   {
-    if (!ppm_) {
-      throw std::runtime_error("fail to open ppm file for writing");
+    if (!streamer_) {
+      throw std::runtime_error("fail to alloc av_streamer");
+    }
+    if (ppm_path) {
+      ppm_.open(ppm_path, std::fstream::binary | std::fstream::trunc);
+      if (!ppm_) {
+        throw std::runtime_error("fail to open ppm file for writing");
+      }
     }
   }
 
@@ -52,10 +59,14 @@ class LiveStreamer {
 
  private:
   void on_audio(unsigned char* data, int samples) {
-    av_streamer_write_samples(streamer_.get(), data, samples);
+    av_streamer_write_audio(streamer_.get(), data, samples);
   }
 
   void on_video(unsigned char* planes[], int strides[]) {
+    auto pts = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_time_).count();
+    av_streamer_write_video(streamer_.get(), planes, strides, pts);
+
     if (ppm_.is_open()) {
       if (++frame_cnt_ == 10) {
         std::vector<uint8_t> rgb24_buf(VIDEO_WIDTH * VIDEO_HEIGHT * 3);
@@ -72,8 +83,21 @@ class LiveStreamer {
     }
   }
 
+  static av_streamer_t* alloc_streamer(const char* url) {
+    av_streamer_opts_t opts;
+    av_streamer_opts_default(&opts);
+    opts.sample_rate = SAMPLE_RATE;
+    opts.nb_channels = NB_CHANNELS;
+    opts.url = url;
+    opts.width = VIDEO_WIDTH;
+    opts.height = VIDEO_HEIGHT;
+    opts.frame_rate = FRAME_RATE;
+    return av_streamer_alloc2(&opts);
+  }
+
   std::unique_ptr<av_streamer_t, decltype(&av_streamer_free)> streamer_;
   MediaCapture media_capture_;
+  std::chrono::steady_clock::time_point start_time_;
   std::ofstream ppm_;
   int frame_cnt_ = 0;
 };
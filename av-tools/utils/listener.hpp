@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <stdexcept>
 #include <utility>
@@ -18,6 +19,29 @@ namespace av {
 
 namespace utils {
 
+#ifdef SO_REUSEPORT
+// SO_REUSEPORT as an Asio SettableSocketOption, Asio has no public type for it.
+class ReusePort {
+ public:
+  explicit ReusePort(bool on) : value_(on ? 1 : 0) { }
+
+  template <typename Protocol>
+  int level(const Protocol&) const { return SOL_SOCKET; }
+
+  template <typename Protocol>
+  int name(const Protocol&) const { return SO_REUSEPORT; }
+
+  template <typename Protocol>
+  const void* data(const Protocol&) const { return &value_; }
+
+  template <typename Protocol>
+  std::size_t size(const Protocol&) const { return sizeof(value_); }
+
+ private:
+  int value_;
+};
+#endif
+
 class Listener : public std::enable_shared_from_this<Listener> {
   using socket_base = boost::asio::socket_base;
 
@@ -26,7 +50,9 @@ class Listener : public std::enable_shared_from_this<Listener> {
   using endpoint = boost::asio::ip::tcp::endpoint;
   using socket = boost::asio::ip::tcp::socket;
 
-  Listener(boost::asio::io_context& io, endpoint ep)
+  // reuse_port lets one Listener per io_context bind the same endpoint, the
+  // kernel then spreads incoming connections across them (SO_REUSEPORT)
+  Listener(boost::asio::io_context& io, endpoint ep, bool reuse_port = false)
       : io_(io),
         acceptor_(boost::asio::make_strand(io))
   {
@@ -34,6 +60,14 @@ class Listener : public std::enable_shared_from_this<Listener> {
 
     acceptor_.set_option(socket_base::reuse_address(true));
 
+    if (reuse_port) {
+#ifdef SO_REUSEPORT
+      acceptor_.set_option(ReusePort(true));
+#else
+      throw std::runtime_error("Listener: SO_REUSEPORT not supported");
+#endif
+    }
+
     acceptor_.bind(ep);
 
     acceptor_.listen(socket_base::max_listen_connections);
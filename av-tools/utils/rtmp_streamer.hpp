@@ -7,11 +7,18 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
 #include <librtmp/rtmp.h>
 
 namespace av {
@@ -28,6 +35,9 @@ class RTMPStreamer {
 
     RTMP_Init(r_.get());
 
+    // librtmp waits 30 s by default, a " timeout=N" url option still wins
+    r_->Link.timeout = connect_timeout_sec;
+
     if (!RTMP_SetupURL(r_.get(), const_cast<char*>(url_.c_str()))) {
       throw std::runtime_error("RTMPStreamer: error setting URL");
     }
@@ -37,6 +47,10 @@ class RTMPStreamer {
 
   ~RTMPStreamer() {
     RTMP_Close(r_.get());
+    int fd = wake_fd_.exchange(-1);
+    if (fd >= 0) {
+      close(fd);
+    }
   }
 
   bool connect() {
@@ -48,6 +62,25 @@ class RTMPStreamer {
       return false;
     }
 
+    // don't rely on librtmp for this, every tag is written as soon as it is muxed
+    int on = 1;
+    setsockopt(RTMP_Socket(r_.get()), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    // a peer that stops reading fails the write instead of blocking it for good
+    timeval tv{send_timeout_sec, 0};
+    setsockopt(RTMP_Socket(r_.get()), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // librtmp closes its fd when a write fails, and the number can then be
+    // reused by another connection. A dup keeps this socket for interrupt().
+    int fd = dup(RTMP_Socket(r_.get()));
+    if (fd < 0) {
+      return false;
+    }
+    fd = wake_fd_.exchange(fd);
+    if (fd >= 0) {
+      close(fd);
+    }
+
     return true;
   }
 
@@ -55,9 +88,22 @@ class RTMPStreamer {
     return RTMP_Write(r_.get(), reinterpret_cast<const char*>(buf), size);
   }
 
+  // from another thread, fails a write that is blocked on the socket;
+  // never touches librtmp's state, which belongs to the writer
+  void interrupt() {
+    int fd = wake_fd_.load();
+    if (fd >= 0) {
+      shutdown(fd, SHUT_RDWR);
+    }
+  }
+
  private:
+  static constexpr int connect_timeout_sec = 5;
+  static constexpr int send_timeout_sec = 5;
+
   const std::string url_;
   std::unique_ptr<RTMP, decltype(&RTMP_Free)> r_;
+  std::atomic<int> wake_fd_{-1};  // dup of the connected socket
 };
 
 }
@@ -0,0 +1,120 @@
+//
+//  server_runtime.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "av-tools/utils/thread_affinity.hpp"
+
+namespace av {
+
+namespace utils {
+
+// One single-threaded io_context per core. Give each context its own
+// Listener with reuse_port set: the kernel balances connections across the
+// acceptors, and every session stays on the thread that accepted it, so
+// no reactor or strand is shared between cores.
+//
+//   ServerRuntime runtime(0, true);
+//   runtime.each([&](boost::asio::io_context& io, std::size_t) {
+//     std::make_shared<MyListener>(io, ep, true)->start();
+//   });
+//   runtime.join();
+class ServerRuntime {
+  using executor_type = boost::asio::io_context::executor_type;
+
+ public:
+  ServerRuntime(const ServerRuntime&) = delete;
+  ServerRuntime& operator=(const ServerRuntime&) = delete;
+
+  // nb_threads = 0 uses one thread per core, pin binds thread i to core i % cores (Linux only)
+  explicit ServerRuntime(std::size_t nb_threads = 0, bool pin = false) {
+    std::size_t nb_cores = std::thread::hardware_concurrency();
+    if (!nb_cores) {
+      nb_cores = 1;
+    }
+    if (!nb_threads) {
+      nb_threads = nb_cores;
+    }
+
+    ios_.reserve(nb_threads);
+    works_.reserve(nb_threads);
+    for (std::size_t i = 0; i != nb_threads; ++i) {
+      // concurrency hint 1, each context is only run by its own thread
+      ios_.push_back(std::make_unique<boost::asio::io_context>(1));
+      works_.push_back(boost::asio::make_work_guard(*ios_.back()));
+    }
+
+    // the started threads must be joined if a later one cannot start
+    threads_.reserve(nb_threads);
+    try {
+      for (std::size_t i = 0; i != nb_threads; ++i) {
+        threads_.emplace_back([io = ios_[i].get()] { io->run(); });
+        if (pin) {
+          pin_thread(threads_.back(), i % nb_cores);
+        }
+      }
+    } catch (...) {
+      stop();
+      join();
+      throw;
+    }
+  }
+
+  virtual ~ServerRuntime() {
+    stop();
+    join();
+  }
+
+  inline std::size_t size() const { return ios_.size(); }
+
+  inline boost::asio::io_context& context(std::size_t i) { return *ios_[i]; }
+
+  // fn(io_context&, index) once per thread, typically to start a Listener
+  template <typename Fn>
+  void each(Fn&& fn) {
+    for (std::size_t i = 0; i != ios_.size(); ++i) {
+      fn(*ios_[i], i);
+    }
+  }
+
+  // Threads return once their contexts run out of work. A running Listener's
+  // pending accept and every open session's pending read count as work, so
+  // join() waits until those are closed; stop() does not wait for them.
+  void shutdown() {
+    works_.clear();
+  }
+
+  // threads return as soon as possible, abandoning pending handlers
+  void stop() {
+    for (auto& io : ios_) {
+      io->stop();
+    }
+  }
+
+  void join() {
+    for (auto& t : threads_) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+  }
+
+ private:
+  std::vector<std::unique_ptr<boost::asio::io_context>> ios_;
+  std::vector<boost::asio::executor_work_guard<executor_type>> works_;
+  std::vector<std::thread> threads_;
+};
+
+} // utils
+
+} // av
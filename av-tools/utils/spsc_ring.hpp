@@ -0,0 +1,106 @@
+//
+//  spsc_ring.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace av {
+
+namespace utils {
+
+// Lock-free single-producer/single-consumer byte ring.
+// write()/reserve()/commit() are only called by the producer,
+// read_span()/consume() only by the consumer.
+class SPSCRing {
+ public:
+  SPSCRing(const SPSCRing&) = delete;
+  SPSCRing& operator=(const SPSCRing&) = delete;
+
+  explicit SPSCRing(std::size_t capacity)
+      : buf_(new uint8_t[capacity]), capacity_(capacity)
+  {
+    if (!capacity) {
+      throw std::invalid_argument("SPSCRing: invalid capacity");
+    }
+  }
+
+  ~SPSCRing() = default;
+
+  inline std::size_t capacity() const { return capacity_; }
+
+  inline std::size_t read_available() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+  }
+
+  inline std::size_t write_available() const {
+    return capacity_ - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire));
+  }
+
+  // all-or-nothing, never blocks
+  bool write(const uint8_t* data, std::size_t size) {
+    std::pair<uint8_t*, std::size_t> spans[2];
+    if (!reserve(size, spans)) {
+      return false;
+    }
+
+    std::memcpy(spans[0].first, data, spans[0].second);
+    std::memcpy(spans[1].first, data + spans[0].second, spans[1].second);
+    commit(size);
+    return true;
+  }
+
+  // Room for size bytes to be filled in place, spans[0] and then spans[1],
+  // which is empty unless the region wraps. Returns false if there is no room.
+  // Nothing is readable until commit(size).
+  bool reserve(std::size_t size, std::pair<uint8_t*, std::size_t> (&spans)[2]) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    std::size_t tail = tail_.load(std::memory_order_acquire);
+    if (capacity_ - (head - tail) < size) {
+      return false;
+    }
+
+    std::size_t pos = head % capacity_;
+    std::size_t n = std::min(size, capacity_ - pos);
+    spans[0] = {buf_.get() + pos, n};
+    spans[1] = {buf_.get(), size - n};
+    return true;
+  }
+
+  inline void commit(std::size_t size) {
+    head_.store(head_.load(std::memory_order_relaxed) + size, std::memory_order_release);
+  }
+
+  // contiguous readable region, the wrapped part is returned by the next call
+  std::pair<const uint8_t*, std::size_t> read_span() const {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    std::size_t head = head_.load(std::memory_order_acquire);
+    std::size_t pos = tail % capacity_;
+    return {buf_.get() + pos, std::min(head - tail, capacity_ - pos)};
+  }
+
+  inline void consume(std::size_t size) {
+    tail_.store(tail_.load(std::memory_order_relaxed) + size, std::memory_order_release);
+  }
+
+ private:
+  std::unique_ptr<uint8_t[]> buf_;
+  const std::size_t capacity_;
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+} // utils
+
+} // av
@@ -0,0 +1,99 @@
+//
+//  stats.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+namespace av {
+
+namespace utils {
+
+// Lock-free latency histogram, bucket i holds samples in [2^(i-1), 2^i) ns.
+// record() is a handful of relaxed atomics, cheap enough to leave on.
+class LatencyHistogram {
+ public:
+  static constexpr int nb_buckets = 40;
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  LatencyHistogram() = default;
+
+  ~LatencyHistogram() = default;
+
+  static inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void record(uint64_t ns) {
+    int idx = std::bit_width(ns);
+    buckets_[idx < nb_buckets ? idx : nb_buckets - 1].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) { }
+  }
+
+  inline uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+  inline uint64_t total_ns() const { return total_ns_.load(std::memory_order_relaxed); }
+
+  inline uint64_t max_ns() const { return max_ns_.load(std::memory_order_relaxed); }
+
+  // upper bound of the bucket holding the p-th percentile, p in [0, 100]
+  uint64_t percentile_ns(double p) const {
+    uint64_t n = count();
+    if (!n) {
+      return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(n * p / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i != nb_buckets; ++i) {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen > rank) {
+        return i ? (uint64_t(1) << i) - 1 : 0;
+      }
+    }
+
+    return max_ns();
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, nb_buckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> total_ns_{0};
+  std::atomic<uint64_t> max_ns_{0};
+};
+
+class ScopedLatency {
+ public:
+  ScopedLatency(const ScopedLatency&) = delete;
+  ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+  explicit ScopedLatency(LatencyHistogram& hist)
+      : hist_(hist), start_ns_(LatencyHistogram::now_ns()) { }
+
+  ~ScopedLatency() {
+    hist_.record(LatencyHistogram::now_ns() - start_ns_);
+  }
+
+ private:
+  LatencyHistogram& hist_;
+  const uint64_t start_ns_;
+};
+
+} // utils
+
+} // av
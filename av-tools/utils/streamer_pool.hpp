@@ -0,0 +1,82 @@
+//
+//  streamer_pool.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "av-tools/utils/thread_affinity.hpp"
+
+namespace av {
+
+namespace utils {
+
+// Fixed set of worker threads shared by many sessions. All workers run the
+// same io_context, so any idle worker picks up the next ready task; each
+// session posts through its own strand to keep its tasks in order.
+class StreamerPool {
+ public:
+  using executor_type = boost::asio::io_context::executor_type;
+  using strand_type = boost::asio::strand<executor_type>;
+
+  StreamerPool(const StreamerPool&) = delete;
+  StreamerPool& operator=(const StreamerPool&) = delete;
+
+  // nb_threads = 0 uses one thread per core, pin binds worker i to core i % cores (Linux only)
+  explicit StreamerPool(std::size_t nb_threads = 0, bool pin = false)
+      : work_(boost::asio::make_work_guard(io_))
+  {
+    std::size_t nb_cores = std::thread::hardware_concurrency();
+    if (!nb_cores) {
+      nb_cores = 1;
+    }
+    if (!nb_threads) {
+      nb_threads = nb_cores;
+    }
+
+    // the started workers must be joined if a later one cannot start
+    threads_.reserve(nb_threads);
+    try {
+      for (std::size_t i = 0; i != nb_threads; ++i) {
+        threads_.emplace_back([this] { io_.run(); });
+        if (pin) {
+          pin_thread(threads_.back(), i % nb_cores);
+        }
+      }
+    } catch (...) {
+      io_.stop();
+      for (auto& t : threads_) {
+        t.join();
+      }
+      throw;
+    }
+  }
+
+  virtual ~StreamerPool() {
+    work_.reset();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  inline std::size_t size() const { return threads_.size(); }
+
+  inline strand_type make_strand() { return boost::asio::make_strand(io_.get_executor()); }
+
+ private:
+  boost::asio::io_context io_;
+  boost::asio::executor_work_guard<executor_type> work_;
+  std::vector<std::thread> threads_;
+};
+
+} // utils
+
+} // av
@@ -0,0 +1,38 @@
+//
+//  thread_affinity.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace av {
+
+namespace utils {
+
+// Binds t to one core, where the platform supports it.
+inline void pin_thread(std::thread& t, std::size_t core) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  pthread_setaffinity_np(t.native_handle(), sizeof(cpus), &cpus);
+#else
+  // no hard affinity on this platform, leave placement to the scheduler
+  (void) t;
+  (void) core;
+#endif
+}
+
+} // utils
+
+} // av
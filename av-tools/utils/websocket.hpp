@@ -7,13 +7,15 @@
 
 #pragma once
 
+#include <algorithm>
 #include <chrono>
-#include <list>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/beast.hpp>
@@ -24,6 +26,130 @@ namespace av {
 
 namespace utils {
 
+// A queued outgoing frame. The payload is immutable and held by reference,
+// so one buffer can sit in the queues of many sessions at once.
+struct WSMessage {
+  std::shared_ptr<const std::string> payload;  // nullptr queues a close
+  bool binary = false;
+};
+
+struct WSQueueOptions {
+  enum Policy {
+    drop_oldest,   // queued messages make room for new ones
+    drop_newest,   // new messages are dropped until the queue is below low_watermark
+    disconnect,    // the session is closed
+  };
+
+  std::size_t capacity = 1024;            // messages
+  std::size_t high_watermark = 4 << 20;   // queued bytes that trigger the policy
+  std::size_t low_watermark = 1 << 20;    // dropping stops below this
+  Policy policy = disconnect;              // dropping is silent, opt in where losing messages is fine
+};
+
+// Bounded FIFO of outgoing messages on a fixed ring, one spare slot is kept
+// for the close frame so a full queue can always be closed.
+class WSWriteQueue {
+ public:
+  WSWriteQueue(const WSWriteQueue&) = delete;
+  WSWriteQueue& operator=(const WSWriteQueue&) = delete;
+
+  explicit WSWriteQueue(const WSQueueOptions& opts)
+      : opts_(opts),
+        slots_(std::max<std::size_t>(opts.capacity, 1) + 1)
+  {
+    if (opts_.low_watermark > opts_.high_watermark) {
+      throw std::invalid_argument("WSWriteQueue: low_watermark above high_watermark");
+    }
+  }
+
+  ~WSWriteQueue() = default;
+
+  inline bool empty() const { return !size_; }
+
+  inline std::size_t size() const { return size_; }
+
+  inline std::size_t bytes() const { return bytes_; }
+
+  inline std::size_t dropped() const { return dropped_; }
+
+  inline WSMessage& front() { return slots_[head_]; }
+
+  // front_busy: front() is being written and must stay queued.
+  // Returns false if the limits are exceeded and the policy is disconnect.
+  bool push(WSMessage&& msg, bool front_busy) {
+    if (msg.payload) {
+      std::size_t size = msg.payload->size();
+
+      if (shedding_ && bytes_ <= opts_.low_watermark && size_ < capacity()) {
+        shedding_ = false;
+      }
+
+      if (!shedding_ && (size_ >= capacity() || bytes_ + size > opts_.high_watermark)) {
+        switch (opts_.policy) {
+          case WSQueueOptions::drop_oldest:
+            while (size_ > (front_busy ? 1u : 0u)
+                   && (size_ >= capacity() || bytes_ + size > opts_.low_watermark)) {
+              drop_oldest(front_busy);
+            }
+            break;
+          case WSQueueOptions::drop_newest:
+            shedding_ = true;
+            break;
+          case WSQueueOptions::disconnect:
+            return false;
+        }
+      }
+
+      // a busy front can leave the ring full
+      if (shedding_ || size_ >= capacity()) {
+        ++dropped_;
+        return true;
+      }
+
+      bytes_ += size;
+    }
+
+    slots_[(head_ + size_) % slots_.size()] = std::move(msg);
+    ++size_;
+    return true;
+  }
+
+  void pop_front() {
+    if (slots_[head_].payload) {
+      bytes_ -= slots_[head_].payload->size();
+    }
+    slots_[head_] = WSMessage{};
+    head_ = (head_ + 1) % slots_.size();
+    --size_;
+  }
+
+ private:
+  inline std::size_t capacity() const { return slots_.size() - 1; }
+
+  // the payload of a busy front is kept alive by its shared_ptr, only the slot moves
+  void drop_oldest(bool front_busy) {
+    if (front_busy) {
+      std::size_t next = (head_ + 1) % slots_.size();
+      bytes_ -= slots_[next].payload->size();
+      slots_[next] = std::move(slots_[head_]);
+      slots_[head_] = WSMessage{};
+      head_ = next;
+      --size_;
+    } else {
+      pop_front();
+    }
+    ++dropped_;
+  }
+
+  const WSQueueOptions opts_;
+  std::vector<WSMessage> slots_;
+  std::size_t head_ = 0;
+  std::size_t size_ = 0;
+  std::size_t bytes_ = 0;
+  std::size_t dropped_ = 0;
+  bool shedding_ = false;
+};
+
 class WSSCliSession : public std::enable_shared_from_this<WSSCliSession> {
   using tcp_stream = boost::beast::tcp_stream;
   using ssl_stream = boost::asio::ssl::stream<tcp_stream>;
@@ -38,9 +164,11 @@ class WSSCliSession : public std::enable_shared_from_this<WSSCliSession> {
 
   WSSCliSession(boost::asio::io_context& io, ssl_context& ssl,
                 std::string_view host, std::string_view port,
-                std::string_view url)
+                std::string_view url,
+                const WSQueueOptions& queue_opts = {})
       : resolver_(boost::asio::make_strand(io)),
         ws_(resolver_.get_executor(), ssl),
+        msg_queue_(queue_opts),
         host_(host),
         port_(port),
         url_(url)
@@ -68,6 +196,9 @@ class WSSCliSession : public std::enable_shared_from_this<WSSCliSession> {
 
   response_type& get_response_from_cb() { return resp_; }
 
+  // inside on_message_cb, whether the message arrived in binary frames
+  bool got_binary() const { return ws_.got_binary(); }
+
   virtual void run() {
     boost::asio::post(ws_.get_executor(),
                       boost::beast::bind_front_handler(&WSSCliSession::on_post_run,
@@ -75,10 +206,23 @@ class WSSCliSession : public std::enable_shared_from_this<WSSCliSession> {
   }
 
   virtual void send(std::string_view msg) {
-    boost::asio::post(ws_.get_executor(),
-                      boost::beast::bind_front_handler(&WSSCliSession::on_post_send,
-                                                       shared_from_this(),
-                                                       std::make_shared<std::string>(msg)));
+    send(std::make_shared<const std::string>(msg), false);
+  }
+
+  // No copy, pass the same payload to every session of a broadcast.
+  // Sends from any thread are collected in an inbox, one post moves them all.
+  virtual void send(std::shared_ptr<const std::string> payload, bool binary) {
+    bool post = false;
+    {
+      std::lock_guard<std::mutex> lk(inbox_mtx_);
+      post = inbox_.empty();
+      inbox_.push_back(WSMessage{std::move(payload), binary});
+    }
+    if (post) {
+      boost::asio::post(ws_.get_executor(),
+                        boost::beast::bind_front_handler(&WSSCliSession::on_post_send,
+                                                         shared_from_this()));
+    }
   }
 
   virtual void close() {
@@ -108,10 +252,26 @@ class WSSCliSession : public std::enable_shared_from_this<WSSCliSession> {
     }
   }
 
-  void on_post_send(std::shared_ptr<std::string> p_msg) {
+  void on_post_send() {
+    {
+      std::lock_guard<std::mutex> lk(inbox_mtx_);
+      batch_.swap(inbox_);
+    }
+    for (auto& msg : batch_) {
+      enqueue(std::move(msg));
+    }
+    batch_.clear();
+  }
+
+  void enqueue(WSMessage msg) {
     if (open_ >= 0 && close_ < 0) {
       bool idle = (open_ > 0) && msg_queue_.empty();
-      msg_queue_.push_back(p_msg);
+      bool busy = (open_ > 0) && !msg_queue_.empty();
+      if (!msg_queue_.push(std::move(msg), busy)) {
+        on_error_cb(std::runtime_error("WebSocket: slow consumer, write queue full"));
+        on_post_close(true);
+        return;
+      }
       if (idle) {
         async_write();
       }
@@ -131,7 +291,7 @@ class WSSCliSession : public std::enable_shared_from_this<WSSCliSession> {
           on_disconnect(boost::asio::error::operation_aborted);
         } else {
           resolver_.cancel();
-          on_post_send(nullptr);
+          enqueue(WSMessage{});
           close_ = 0;
         }
       }
@@ -236,9 +396,10 @@ class WSSCliSession : public std::enable_shared_from_this<WSSCliSession> {
 
   inline void async_write() {
     if (!msg_queue_.empty()) {
-      auto& p_msg = msg_queue_.front();
-      if (p_msg) {
-        ws_.async_write(boost::asio::buffer(*p_msg),
+      const auto& msg = msg_queue_.front();
+      if (msg.payload) {
+        ws_.binary(msg.binary);
+        ws_.async_write(boost::asio::buffer(*msg.payload),
                         boost::beast::bind_front_handler(&WSSCliSession::on_write,
                                                          shared_from_this()));
       } else {
@@ -267,7 +428,10 @@ class WSSCliSession : public std::enable_shared_from_this<WSSCliSession> {
   request_type req_;
   response_type resp_;
   boost::beast::flat_buffer buf_;
-  std::list<std::shared_ptr<std::string>> msg_queue_;
+  WSWriteQueue msg_queue_;
+  std::mutex inbox_mtx_;
+  std::vector<WSMessage> inbox_;
+  std::vector<WSMessage> batch_;
   std::string host_;
   std::string port_;
   std::string url_;
@@ -285,7 +449,9 @@ class WSSvrSession : public std::enable_shared_from_this<WSSvrSession> {
   using request_type = boost::beast::websocket::request_type;
   using response_type = boost::beast::websocket::response_type;
 
-  WSSvrSession(socket&& s) : ws_(std::move(s)) { }
+  WSSvrSession(socket&& s, const WSQueueOptions& queue_opts = {})
+      : ws_(std::move(s)),
+        msg_queue_(queue_opts) { }
 
   virtual ~WSSvrSession() { }
 
@@ -303,6 +469,9 @@ class WSSvrSession : public std::enable_shared_from_this<WSSvrSession> {
 
   response_type& get_response_from_cb() { return resp_; }
 
+  // inside on_message_cb, whether the message arrived in binary frames
+  bool got_binary() const { return ws_.got_binary(); }
+
   virtual void run() {
     boost::asio::post(ws_.get_executor(),
                       boost::beast::bind_front_handler(&WSSvrSession::on_post_run,
@@ -310,10 +479,23 @@ class WSSvrSession : public std::enable_shared_from_this<WSSvrSession> {
   }
 
   virtual void send(std::string_view msg) {
-    boost::asio::post(ws_.get_executor(),
-                      boost::beast::bind_front_handler(&WSSvrSession::on_post_send,
-                                                       shared_from_this(),
-                                                       std::make_shared<std::string>(msg)));
+    send(std::make_shared<const std::string>(msg), false);
+  }
+
+  // No copy, pass the same payload to every session of a broadcast.
+  // Sends from any thread are collected in an inbox, one post moves them all.
+  virtual void send(std::shared_ptr<const std::string> payload, bool binary) {
+    bool post = false;
+    {
+      std::lock_guard<std::mutex> lk(inbox_mtx_);
+      post = inbox_.empty();
+      inbox_.push_back(WSMessage{std::move(payload), binary});
+    }
+    if (post) {
+      boost::asio::post(ws_.get_executor(),
+                        boost::beast::bind_front_handler(&WSSvrSession::on_post_send,
+                                                         shared_from_this()));
+    }
   }
 
   virtual void close() {
@@ -344,10 +526,26 @@ class WSSvrSession : public std::enable_shared_from_this<WSSvrSession> {
     }
   }
 
-  void on_post_send(std::shared_ptr<std::string> p_msg) {
+  void on_post_send() {
+    {
+      std::lock_guard<std::mutex> lk(inbox_mtx_);
+      batch_.swap(inbox_);
+    }
+    for (auto& msg : batch_) {
+      enqueue(std::move(msg));
+    }
+    batch_.clear();
+  }
+
+  void enqueue(WSMessage msg) {
     if (open_ >= 0 && close_ < 0) {
       bool idle = (open_ > 0) && msg_queue_.empty();
-      msg_queue_.push_back(p_msg);
+      bool busy = (open_ > 0) && !msg_queue_.empty();
+      if (!msg_queue_.push(std::move(msg), busy)) {
+        on_error_cb(std::runtime_error("WebSocket: slow consumer, write queue full"));
+        on_post_close(true);
+        return;
+      }
       if (idle) {
         async_write();
       }
@@ -365,7 +563,7 @@ class WSSvrSession : public std::enable_shared_from_this<WSSvrSession> {
         if (open_ < 0) {
           on_disconnect(boost::asio::error::operation_aborted);
         } else {
-          on_post_send(nullptr);
+          enqueue(WSMessage{});
           close_ = 0;
         }
       }
@@ -445,9 +643,10 @@ class WSSvrSession : public std::enable_shared_from_this<WSSvrSession> {
 
   inline void async_write() {
     if (!msg_queue_.empty()) {
-      auto& p_msg = msg_queue_.front();
-      if (p_msg) {
-        ws_.async_write(boost::asio::buffer(*p_msg),
+      const auto& msg = msg_queue_.front();
+      if (msg.payload) {
+        ws_.binary(msg.binary);
+        ws_.async_write(boost::asio::buffer(*msg.payload),
                         boost::beast::bind_front_handler(&WSSvrSession::on_write,
                                                          shared_from_this()));
       } else {
@@ -475,7 +674,10 @@ class WSSvrSession : public std::enable_shared_from_this<WSSvrSession> {
   boost::beast::flat_buffer buf_;
   request_type req_;
   response_type resp_;
-  std::list<std::shared_ptr<std::string>> msg_queue_;
+  WSWriteQueue msg_queue_;
+  std::mutex inbox_mtx_;
+  std::vector<WSMessage> inbox_;
+  std::vector<WSMessage> batch_;
   int open_ = -1;
   int close_ = -1;
 };
@@ -0,0 +1,339 @@
+//
+//  ws_gateway.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "av-tools/capi/av_streamer.h"
+#include "av-tools/utils/listener.hpp"
+#include "av-tools/utils/websocket.hpp"
+
+namespace av {
+
+namespace utils {
+
+struct WSGatewayOptions {
+  std::string rtmp_base;                 // the stream name is appended, e.g. "rtmp://127.0.0.1/live/"
+  std::size_t pool_threads = 0;          // encode/mux workers shared by all sessions, 0 for one per core
+  std::size_t blocking_threads = 64;     // RTMP connects and teardowns in flight at once
+  int connect_wait_ms = 10000;           // a session still waiting to connect after this is closed
+  std::size_t max_pending_bytes = 1 << 20;  // audio buffered per session while connecting
+  int async_buffer_ms = 1000;
+  int output = AV_STREAMER_OUTPUT_FFMPEG;
+  bool io_pool = true;                   // RTMP writes on a shared I/O pool, false for a thread per session
+  std::size_t io_threads = 0;            // size of that pool, 0 for two per core
+  int mux_queue_size = 256;              // packets queued per session for its RTMP writes
+  int drop_policy = AV_STREAMER_QUEUE_DROP_UNTIL_KEYFRAME;  // when that queue is full
+};
+
+// State shared by a gateway and its sessions. Connecting and closing an RTMP
+// output blocks, so it runs on its own threads and never on the io_context.
+// A connect to an unreachable upstream holds a blocking thread for up to the
+// 5 s connect timeout, so size blocking_threads to the connects expected at
+// once; sessions queued for longer than connect_wait_ms are closed instead
+// of connecting late.
+// RTMP writes block too, so they run on the I/O pool and never on the encode
+// pool: a stalled upstream fills its own queue and drops, and holds one I/O
+// thread until the write times out and the session is closed.
+class WSGatewayContext {
+ public:
+  WSGatewayContext(const WSGatewayContext&) = delete;
+  WSGatewayContext& operator=(const WSGatewayContext&) = delete;
+
+  explicit WSGatewayContext(const WSGatewayOptions& opts)
+      : opts_(opts),
+        pool_(av_streamer_pool_alloc(static_cast<int>(opts.pool_threads), 0)),
+        blocking_(opts.blocking_threads ? opts.blocking_threads : 1)
+  {
+    if (!pool_) {
+      throw std::runtime_error("WSGatewayContext: error allocating streamer pool");
+    }
+    if (opts.io_pool) {
+      std::size_t io_threads = opts.io_threads ? opts.io_threads : 2 * std::max(1u, std::thread::hardware_concurrency());
+      io_pool_ = av_streamer_pool_alloc(static_cast<int>(io_threads), 0);
+      if (!io_pool_) {
+        av_streamer_pool_free(pool_);
+        throw std::runtime_error("WSGatewayContext: error allocating io pool");
+      }
+    }
+  }
+
+  // sessions are gone, finish pending teardowns before the pools go
+  virtual ~WSGatewayContext() {
+    blocking_.wait();
+    av_streamer_pool_free(io_pool_);
+    av_streamer_pool_free(pool_);
+  }
+
+  inline const WSGatewayOptions& options() const { return opts_; }
+
+  inline av_streamer_pool_t* pool() { return pool_; }
+
+  inline av_streamer_pool_t* io_pool() { return io_pool_; }
+
+  inline boost::asio::thread_pool& blocking() { return blocking_; }
+
+ private:
+  const WSGatewayOptions opts_;
+  av_streamer_pool_t* pool_;
+  av_streamer_pool_t* io_pool_ = nullptr;
+  boost::asio::thread_pool blocking_;
+};
+
+// One publisher. The request target names the stream and its input:
+//   /<stream>?codec=pcm&rate=48000&channels=2&format=s16
+//   /<stream>?codec=aac&rate=44100&channels=2   (ADTS)
+// format is s16, s32, flt or dbl, with a "p" suffix for planar input, where a
+// message holds each channel's samples back to back. Binary messages carry
+// the audio, text messages are ignored. A PCM message that is not a whole
+// number of sample frames closes the session.
+class WSGatewaySession : public WSSvrSession {
+ public:
+  WSGatewaySession(socket&& s, std::shared_ptr<WSGatewayContext> ctx)
+      : WSSvrSession(std::move(s)),
+        ctx_(std::move(ctx)) { }
+
+  virtual ~WSGatewaySession() {
+    release(streamer_);
+  }
+
+  void start() { run(); }
+
+  inline uint64_t dropped_bytes() const { return dropped_bytes_; }
+
+ protected:
+  bool on_handshake_cb() override {
+    av_streamer_opts_default(&opts_);
+    auto target = get_request_from_cb().target();
+    return parse_target(std::string_view(target.data(), target.size()));
+  }
+
+  // the handshake is done, connect without holding up the io thread
+  void on_open_cb() override {
+    opts_.url = url_.c_str();
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(ctx_->options().connect_wait_ms);
+    boost::asio::post(ctx_->blocking(),
+                      [self = shared_from_base<WSGatewaySession>(), ex = get_executor(), deadline]() mutable {
+      // a backlog of connects would otherwise delay every later session too
+      av_streamer_t* streamer = nullptr;
+      if (!self->closed_ && std::chrono::steady_clock::now() < deadline) {
+        streamer = av_streamer_alloc2(&self->opts_);
+      }
+      // the last reference must not be dropped on a blocking thread
+      boost::asio::post(ex, [self = std::move(self), streamer] {
+        self->on_streamer(streamer);
+      });
+    });
+  }
+
+  void on_close_cb() override {
+    closed_ = true;
+    pending_.clear();
+    release(streamer_);
+    streamer_ = nullptr;
+  }
+
+  void on_message_cb(std::string_view msg) override {
+    if (!got_binary() || closed_) {
+      return;
+    }
+
+    if (!streamer_) {
+      if (pending_bytes_ + msg.size() > ctx_->options().max_pending_bytes) {
+        dropped_bytes_ += msg.size();
+        return;
+      }
+      pending_.emplace_back(msg);
+      pending_bytes_ += msg.size();
+      return;
+    }
+
+    write(msg);
+  }
+
+  void on_error_cb(const std::exception&) override { }
+
+ private:
+  void on_streamer(av_streamer_t* streamer) {
+    if (closed_ || !streamer) {
+      release(streamer);
+      if (!closed_) {
+        close();
+      }
+      return;
+    }
+
+    streamer_ = streamer;
+    for (const auto& msg : pending_) {
+      write(msg);
+    }
+    pending_.clear();
+    pending_bytes_ = 0;
+  }
+
+  // straight from the read buffer into the streamer's ring
+  void write(std::string_view msg) {
+    const auto* data = reinterpret_cast<const unsigned char*>(msg.data());
+    int rc = 0;
+
+    if (opts_.audio_input == AV_STREAMER_AUDIO_AAC_ADTS) {
+      rc = av_streamer_write_audio_packets(streamer_, data, static_cast<int>(msg.size()));
+    } else if (msg.size() % sample_size_) {
+      // a partial frame would shift every plane after the first
+      rc = -1;
+    } else {
+      int nb_samples = static_cast<int>(msg.size() / sample_size_);
+      if (planar_) {
+        std::array<const unsigned char*, max_channels> planes{};
+        for (int c = 0; c != opts_.nb_channels; ++c) {
+          planes[c] = data + static_cast<std::size_t>(c) * nb_samples * (sample_size_ / opts_.nb_channels);
+        }
+        rc = av_streamer_write_audio2(streamer_, planes.data(), nb_samples);
+      } else {
+        rc = av_streamer_write_audio(streamer_, data, nb_samples);
+      }
+    }
+
+    if (rc < 0) {
+      close();
+    } else if (rc > 0) {
+      dropped_bytes_ += msg.size();
+    }
+  }
+
+  // freeing flushes and closes the output, so it blocks too
+  void release(av_streamer_t* streamer) {
+    if (streamer) {
+      boost::asio::post(ctx_->blocking(), [streamer] { av_streamer_free(streamer); });
+    }
+  }
+
+  bool parse_target(std::string_view target) {
+    static constexpr std::pair<std::string_view, int> formats[] = {
+      {"s16", AV_STREAMER_SAMPLE_S16}, {"s32", AV_STREAMER_SAMPLE_S32},
+      {"flt", AV_STREAMER_SAMPLE_FLT}, {"dbl", AV_STREAMER_SAMPLE_DBL},
+      {"s16p", AV_STREAMER_SAMPLE_S16P}, {"s32p", AV_STREAMER_SAMPLE_S32P},
+      {"fltp", AV_STREAMER_SAMPLE_FLTP}, {"dblp", AV_STREAMER_SAMPLE_DBLP},
+    };
+    static constexpr int sample_sizes[] = {2, 4, 4, 8, 2, 4, 4, 8};
+
+    std::string_view path = target.substr(0, target.find('?'));
+    std::string_view query = path.size() < target.size() ? target.substr(path.size() + 1) : std::string_view{};
+    while (!path.empty() && path.front() == '/') {
+      path.remove_prefix(1);
+    }
+    if (path.empty() || path.find("..") != std::string_view::npos) {
+      return false;
+    }
+
+    while (!query.empty()) {
+      std::string_view param = query.substr(0, query.find('&'));
+      query.remove_prefix(std::min(query.size(), param.size() + 1));
+      std::size_t eq = param.find('=');
+      if (eq == std::string_view::npos) {
+        return false;
+      }
+      std::string_view key = param.substr(0, eq);
+      std::string value(param.substr(eq + 1));
+
+      if (key == "codec") {
+        if (value == "aac") {
+          opts_.audio_input = AV_STREAMER_AUDIO_AAC_ADTS;
+        } else if (value != "pcm") {
+          return false;
+        }
+      } else if (key == "rate") {
+        opts_.sample_rate = atoi(value.c_str());
+      } else if (key == "channels") {
+        opts_.nb_channels = atoi(value.c_str());
+      } else if (key == "format") {
+        auto it = std::find_if(std::begin(formats), std::end(formats),
+                               [&value](const auto& f) { return f.first == value; });
+        if (it == std::end(formats)) {
+          return false;
+        }
+        opts_.sample_fmt = it->second;
+      }
+    }
+
+    if (opts_.sample_rate <= 0 || opts_.nb_channels <= 0 || opts_.nb_channels > max_channels) {
+      return false;
+    }
+
+    const auto& gw = ctx_->options();
+    url_ = gw.rtmp_base + std::string(path);
+    opts_.pool = ctx_->pool();
+    opts_.async_buffer_ms = gw.async_buffer_ms;
+    opts_.output = gw.output;
+    opts_.io_pool = ctx_->io_pool();
+    opts_.mux_queue_size = gw.mux_queue_size;
+    opts_.drop_policy = gw.drop_policy;
+    planar_ = opts_.sample_fmt >= AV_STREAMER_SAMPLE_S16P;
+    sample_size_ = static_cast<std::size_t>(sample_sizes[opts_.sample_fmt]) * opts_.nb_channels;
+    return true;
+  }
+
+  static constexpr int max_channels = 8;
+
+  std::shared_ptr<WSGatewayContext> ctx_;
+  av_streamer_opts_t opts_{};
+  std::string url_;
+  av_streamer_t* streamer_ = nullptr;
+  std::vector<std::string> pending_;  // until the streamer is connected
+  std::size_t pending_bytes_ = 0;
+  std::size_t sample_size_ = 0;
+  uint64_t dropped_bytes_ = 0;
+  bool planar_ = false;
+  std::atomic<bool> closed_{false};  // also read by the connect task
+};
+
+// Accepts publishers and republishes each one to rtmp_base + stream name.
+class WSGateway : public Listener {
+ public:
+  WSGateway(boost::asio::io_context& io, endpoint ep, const WSGatewayOptions& opts)
+      : Listener(io, ep),
+        ctx_(std::make_shared<WSGatewayContext>(opts)) { }
+
+  // one gateway per ServerRuntime context, all sharing ctx and the port
+  WSGateway(boost::asio::io_context& io, endpoint ep, std::shared_ptr<WSGatewayContext> ctx, bool reuse_port)
+      : Listener(io, ep, reuse_port),
+        ctx_(std::move(ctx)) { }
+
+  virtual ~WSGateway() { }
+
+  void start() { run(); }
+
+ protected:
+  void on_accept_cb(socket&& s) override {
+    boost::system::error_code ec;
+    s.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    std::make_shared<WSGatewaySession>(std::move(s), ctx_)->start();
+  }
+
+  void on_error_cb(const std::exception&) override { }
+
+ private:
+  std::shared_ptr<WSGatewayContext> ctx_;
+};
+
+} // utils
+
+} // av
@@ -0,0 +1,234 @@
+//
+//  ws_live.hpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "av-tools/capi/av_streamer.h"
+#include "av-tools/utils/listener.hpp"
+#include "av-tools/utils/websocket.hpp"
+
+namespace av {
+
+namespace utils {
+
+class WSLiveViewer;
+
+// One live stream fanned out to its viewers. Every viewer's queue references
+// the same payload; chunks from the C++ callback are shared as the muxer
+// produced them, chunks from chunk_cb are copied once. A new viewer gets
+// the header and the chunks since the last key chunk, so playback starts at
+// once; if that GOP was too big to cache, it waits for the next key chunk.
+class WSLiveHub {
+ public:
+  WSLiveHub(const WSLiveHub&) = delete;
+  WSLiveHub& operator=(const WSLiveHub&) = delete;
+
+  explicit WSLiveHub(std::size_t max_gop_bytes = 2 << 20)
+      : max_gop_bytes_(max_gop_bytes) { }
+
+  virtual ~WSLiveHub() { }
+
+  // av_streamer_chunk_fn that keeps the hub alive:
+  //   av_streamer_add_chunk_output(streamer, "mp4", WSLiveHub::chunk_fn(hub));
+  static av_streamer_chunk_fn chunk_fn(std::shared_ptr<WSLiveHub> hub) {
+    return [hub = std::move(hub)](std::shared_ptr<const std::string> chunk, int flags) {
+      hub->publish(std::move(chunk), flags);
+    };
+  }
+
+  // av_streamer_chunk_cb, with the hub as opaque, for C callers. The hub
+  // must outlive the output.
+  static void chunk_cb(void* opaque, const unsigned char* data, int size, int flags) {
+    static_cast<WSLiveHub*>(opaque)->publish(data, size, flags);
+  }
+
+  void publish(const unsigned char* data, int size, int flags) {
+    publish(std::make_shared<const std::string>(reinterpret_cast<const char*>(data), size), flags);
+  }
+
+  inline void publish(std::shared_ptr<const std::string> chunk, int flags);
+
+  inline void subscribe(std::shared_ptr<WSLiveViewer> viewer);
+
+  inline void unsubscribe(const WSLiveViewer* viewer);
+
+  std::size_t viewers() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return viewers_.size();
+  }
+
+ private:
+  // weak, the viewer holds the hub; a viewer that never runs its close path
+  // (e.g. its io_context was stopped) is pruned by the next publish()
+  struct Entry {
+    std::weak_ptr<WSLiveViewer> viewer;
+    const WSLiveViewer* id;  // for unsubscribe(), also once the viewer is gone
+    bool started;  // has been sent a key chunk
+  };
+
+  const std::size_t max_gop_bytes_;
+  mutable std::mutex mtx_;
+  std::shared_ptr<const std::string> header_;
+  std::vector<std::shared_ptr<const std::string>> gop_;  // empty until the next key chunk
+  std::size_t gop_bytes_ = 0;
+  std::vector<Entry> viewers_;
+};
+
+// Looks up the hub for a request target, nullptr rejects the viewer.
+using WSLiveResolver = std::function<std::shared_ptr<WSLiveHub>(std::string_view target)>;
+
+// One viewer. Dropping queued chunks would corrupt the stream, so by default
+// a viewer that falls behind by more than the high watermark is disconnected.
+class WSLiveViewer : public WSSvrSession {
+ public:
+  WSLiveViewer(socket&& s,
+               std::shared_ptr<const WSLiveResolver> resolver,
+               const WSQueueOptions& queue_opts = default_queue_options())
+      : WSSvrSession(std::move(s), queue_opts),
+        resolver_(std::move(resolver)) { }
+
+  virtual ~WSLiveViewer() { }
+
+  void start() { run(); }
+
+  // from any thread, the payload is shared with the other viewers
+  void deliver(std::shared_ptr<const std::string> chunk) {
+    send(std::move(chunk), true);
+  }
+
+  static WSQueueOptions default_queue_options() {
+    WSQueueOptions opts;
+    opts.policy = WSQueueOptions::disconnect;
+    return opts;
+  }
+
+ protected:
+  bool on_handshake_cb() override {
+    auto target = get_request_from_cb().target();
+    hub_ = (*resolver_)(std::string_view(target.data(), target.size()));
+    return hub_ != nullptr;
+  }
+
+  void on_open_cb() override {
+    hub_->subscribe(shared_from_base<WSLiveViewer>());
+  }
+
+  void on_close_cb() override {
+    if (hub_) {
+      hub_->unsubscribe(this);
+    }
+  }
+
+  void on_message_cb(std::string_view) override { }
+
+  void on_error_cb(const std::exception&) override { }
+
+ private:
+  std::shared_ptr<const WSLiveResolver> resolver_;
+  std::shared_ptr<WSLiveHub> hub_;
+};
+
+// Accepts viewers and attaches each one to the hub its target resolves to.
+class WSLiveServer : public Listener {
+ public:
+  WSLiveServer(boost::asio::io_context& io, endpoint ep, WSLiveResolver resolver,
+               bool reuse_port = false,
+               const WSQueueOptions& queue_opts = WSLiveViewer::default_queue_options())
+      : Listener(io, ep, reuse_port),
+        resolver_(std::make_shared<const WSLiveResolver>(std::move(resolver))),
+        queue_opts_(queue_opts) { }
+
+  virtual ~WSLiveServer() { }
+
+  void start() { run(); }
+
+ protected:
+  void on_accept_cb(socket&& s) override {
+    boost::system::error_code ec;
+    s.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    std::make_shared<WSLiveViewer>(std::move(s), resolver_, queue_opts_)->start();
+  }
+
+  void on_error_cb(const std::exception&) override { }
+
+ private:
+  std::shared_ptr<const WSLiveResolver> resolver_;
+  const WSQueueOptions queue_opts_;
+};
+
+void WSLiveHub::publish(std::shared_ptr<const std::string> chunk, int flags) {
+  bool key = (flags & AV_STREAMER_CHUNK_KEY) != 0;
+
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (flags & AV_STREAMER_CHUNK_HEADER) {
+    header_ = chunk;
+    gop_.clear();
+    gop_bytes_ = 0;
+  } else if (key) {
+    gop_.assign(1, chunk);
+    gop_bytes_ = chunk->size();
+  } else if (!gop_.empty()) {
+    if (gop_bytes_ + chunk->size() > max_gop_bytes_) {
+      gop_.clear();
+      gop_bytes_ = 0;
+    } else {
+      gop_.push_back(chunk);
+      gop_bytes_ += chunk->size();
+    }
+  }
+
+  // the header goes to everyone, the rest only once a viewer has had a key chunk
+  auto it = viewers_.begin();
+  while (it != viewers_.end()) {
+    auto viewer = it->viewer.lock();
+    if (!viewer) {
+      it = viewers_.erase(it);
+      continue;
+    }
+    if (!it->started && !(flags & AV_STREAMER_CHUNK_HEADER)) {
+      if (!key) {
+        ++it;
+        continue;
+      }
+      it->started = true;
+    }
+    viewer->deliver(chunk);
+    ++it;
+  }
+}
+
+void WSLiveHub::subscribe(std::shared_ptr<WSLiveViewer> viewer) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (header_) {
+    viewer->deliver(header_);
+  }
+  for (const auto& chunk : gop_) {
+    viewer->deliver(chunk);
+  }
+  const WSLiveViewer* id = viewer.get();
+  viewers_.push_back(Entry{std::move(viewer), id, !gop_.empty()});
+}
+
+void WSLiveHub::unsubscribe(const WSLiveViewer* viewer) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  viewers_.erase(std::remove_if(viewers_.begin(), viewers_.end(),
+                                [viewer](const Entry& entry) { return entry.id == viewer; }),
+                 viewers_.end());
+}
+
+} // utils
+
+} // av
@@ -0,0 +1,1026 @@
+//
+//  bench.cpp
+//  av-tools
+//
+//  Created by zhanwang-sky on 2026/10/16.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "av-tools/capi/av_streamer.h"
+#include "av-tools/ffmpeg/avio.hpp"
+#include "av-tools/ffmpeg/ffmpeg_helper.hpp"
+#include "av-tools/ffmpeg/pipeline.hpp"
+#include "av-tools/ffmpeg/sample_kernels.hpp"
+
+extern "C" {
+#include <libavutil/audio_fifo.h>
+}
+
+using namespace av::ffmpeg;
+
+using std::cerr;
+using std::cout;
+
+namespace {
+
+struct Config {
+  const char* name;
+  int sample_rate;
+  int nb_channels;
+};
+
+const Config configs[] = {
+  {"16k_mono", 16000, 1},
+  {"44k1_stereo", 44100, 2},
+  {"48k_stereo", 48000, 2},
+};
+
+struct Result {
+  std::string name;
+  std::string config;
+  int64_t iterations;
+  double ns_per_op;
+  double samples_per_sec;
+  int64_t frame_allocs = -1;  // streamer only, frame pool allocations
+  int64_t frame_alloc_growth = -1;  // streamer only, allocations after the first second
+  double bytes_per_sec = -1;  // demux only
+  double max_ns = -1;         // latency only
+  double rss_per_session = -1;  // session_rss only, resident bytes
+  int64_t mismatches = -1;    // verify only, samples differing from swr
+  double av_drift = -1;       // ring_overflow only, seconds between the audio and video ends
+};
+
+struct Options {
+  int seconds = 10;        // audio duration fed per run
+  int chunk_ms = 10;       // capture chunk size
+  const char* output = "/dev/null";
+  const char* input = nullptr;  // media file for the demux benches
+  int latency_port = 19350;     // local sink of the latency benches
+  int sessions = 64;            // streamers alive at once in the rss benches
+};
+
+using clock_type = std::chrono::steady_clock;
+
+double elapsed_ns(clock_type::time_point start) {
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+std::vector<int16_t> make_tone(const Config& cfg, int nb_samples) {
+  std::vector<int16_t> buf(static_cast<size_t>(nb_samples) * cfg.nb_channels);
+  double p = 0.0;
+  for (int i = 0; i != nb_samples; ++i) {
+    int16_t v = static_cast<int16_t>(sin(p) * INT16_MAX * 0.5);
+    p += 2.0 * M_PI * 950.0 / cfg.sample_rate;
+    for (int c = 0; c != cfg.nb_channels; ++c) {
+      buf[static_cast<size_t>(i) * cfg.nb_channels + c] = v;
+    }
+  }
+  return buf;
+}
+
+// The path av_streamer used before resample_direct: swr_convert into a
+// scratch buffer, then through an AVAudioFifo. Kept here as the baseline.
+Result bench_resample(const Config& cfg, const Options& opts) {
+  int chunk = cfg.sample_rate * opts.chunk_ms / 1000;
+  int64_t iterations = static_cast<int64_t>(opts.seconds) * 1000 / opts.chunk_ms;
+  auto tone = make_tone(cfg, chunk);
+
+  SwrContext* swr = nullptr;
+  if (swr_alloc_set_opts2(&swr,
+                          &ChannelLayoutHelper{1}.get(), AV_SAMPLE_FMT_FLTP, 16000,
+                          &ChannelLayoutHelper{cfg.nb_channels}.get(), AV_SAMPLE_FMT_S16, cfg.sample_rate,
+                          0, nullptr) < 0) {
+    throw std::runtime_error("bench: error setting swr opts");
+  }
+  std::unique_ptr<SwrContext, void (*)(SwrContext*)> swr_guard(swr, [](SwrContext* s) { swr_free(&s); });
+  std::unique_ptr<AVAudioFifo, decltype(&av_audio_fifo_free)>
+      fifo(av_audio_fifo_alloc(AV_SAMPLE_FMT_FLTP, 1, 16000), &av_audio_fifo_free);
+  std::vector<float> scratch(16000);
+  std::vector<float> sink(16000);
+  if (swr_init(swr) < 0) {
+    throw std::runtime_error("bench: error initializing swr");
+  }
+  if (!fifo) {
+    throw std::runtime_error("bench: Cannot allocate memory");
+  }
+
+  const uint8_t* data[1] = {reinterpret_cast<const uint8_t*>(tone.data())};
+  auto start = clock_type::now();
+  for (int64_t i = 0; i != iterations; ++i) {
+    uint8_t* out[1] = {reinterpret_cast<uint8_t*>(scratch.data())};
+    int n = swr_convert(swr, out, static_cast<int>(scratch.size()), data, chunk);
+    if (n < 0 || av_audio_fifo_write(fifo.get(), reinterpret_cast<void* const*>(out), n) < 0) {
+      throw std::runtime_error("bench: error resampling");
+    }
+    void* fifo_out[1] = {sink.data()};
+    av_audio_fifo_read(fifo.get(), fifo_out, av_audio_fifo_size(fifo.get()));
+  }
+  double ns = elapsed_ns(start);
+
+  return {"resample", cfg.name, iterations, ns / iterations, iterations * chunk / (ns * 1e-9)};
+}
+
+// Resampler::resample straight into encoder-sized frames, no FIFO
+Result bench_resample_direct(const Config& cfg, const Options& opts) {
+  int chunk = cfg.sample_rate * opts.chunk_ms / 1000;
+  int64_t iterations = static_cast<int64_t>(opts.seconds) * 1000 / opts.chunk_ms;
+  auto tone = make_tone(cfg, chunk);
+
+  Resampler resampler(cfg.sample_rate, ChannelLayoutHelper{cfg.nb_channels}.get(), AV_SAMPLE_FMT_S16,
+                      16000, ChannelLayoutHelper{1}.get(), AV_SAMPLE_FMT_FLTP);
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> frame(av_frame_alloc(), &frame_deleter);
+  if (!frame) {
+    throw std::runtime_error("bench: Cannot allocate memory");
+  }
+  frame->nb_samples = 1024;
+  frame->format = AV_SAMPLE_FMT_FLTP;
+  av_channel_layout_default(&frame->ch_layout, 1);
+  if (av_frame_get_buffer(frame.get(), 0) < 0) {
+    throw std::runtime_error("bench: error getting buffer");
+  }
+
+  const uint8_t* data[1] = {reinterpret_cast<const uint8_t*>(tone.data())};
+  int filled = 0;
+  auto start = clock_type::now();
+  for (int64_t i = 0; i != iterations; ++i) {
+    int in_samples = chunk;
+    for (;;) {
+      int rc = resampler.resample(data, in_samples, frame.get(), filled);
+      if (rc < 0) {
+        throw std::runtime_error("bench: error resampling");
+      }
+      in_samples = 0;
+      filled += rc;
+      if (filled < frame->nb_samples) {
+        break;
+      }
+      filled = 0;
+    }
+  }
+  double ns = elapsed_ns(start);
+
+  return {"resample_direct", cfg.name, iterations, ns / iterations, iterations * chunk / (ns * 1e-9)};
+}
+
+std::unique_ptr<AVFrame, decltype(&frame_deleter)> make_frame(int nb_samples, int nb_channels, enum AVSampleFormat fmt) {
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> frame(av_frame_alloc(), &frame_deleter);
+  if (!frame) {
+    throw std::runtime_error("bench: Cannot allocate memory");
+  }
+  frame->nb_samples = nb_samples;
+  frame->format = fmt;
+  av_channel_layout_default(&frame->ch_layout, nb_channels);
+  if (av_frame_get_buffer(frame.get(), 0) < 0) {
+    throw std::runtime_error("bench: error getting buffer");
+  }
+  return frame;
+}
+
+// same-rate S16 -> FLTP into 1024-sample frames, through swr or the SIMD kernels
+Result convert_frames(const char* name, const Config& cfg, const Options& opts,
+                      int out_channels, const SampleKernels* kernels) {
+  int chunk = cfg.sample_rate * opts.chunk_ms / 1000;
+  int64_t iterations = static_cast<int64_t>(opts.seconds) * 1000 / opts.chunk_ms;
+  auto tone = make_tone(cfg, chunk);
+
+  Resampler resampler(cfg.sample_rate, ChannelLayoutHelper{cfg.nb_channels}.get(), AV_SAMPLE_FMT_S16,
+                      cfg.sample_rate, ChannelLayoutHelper{out_channels}.get(), AV_SAMPLE_FMT_FLTP);
+  resampler.set_kernels(kernels);
+  auto frame = make_frame(1024, out_channels, AV_SAMPLE_FMT_FLTP);
+
+  const uint8_t* data[1] = {reinterpret_cast<const uint8_t*>(tone.data())};
+  int filled = 0;
+  auto start = clock_type::now();
+  for (int64_t i = 0; i != iterations; ++i) {
+    int in_samples = chunk;
+    for (;;) {
+      int rc = resampler.resample(data, in_samples, frame.get(), filled);
+      if (rc < 0) {
+        throw std::runtime_error("bench: error converting");
+      }
+      in_samples = 0;
+      filled += rc;
+      if (filled < frame->nb_samples) {
+        break;
+      }
+      filled = 0;
+    }
+  }
+  double ns = elapsed_ns(start);
+
+  return {name, cfg.name, iterations, ns / iterations, iterations * chunk / (ns * 1e-9)};
+}
+
+Result bench_convert_swr(const Config& cfg, const Options& opts) {
+  return convert_frames("convert_swr", cfg, opts, cfg.nb_channels, nullptr);
+}
+
+Result bench_convert_simd(const Config& cfg, const Options& opts) {
+  return convert_frames("convert_simd", cfg, opts, cfg.nb_channels, &sample_kernels());
+}
+
+// stereo configs mix down to mono, mono configs up to stereo
+Result bench_downmix_swr(const Config& cfg, const Options& opts) {
+  return convert_frames("downmix_swr", cfg, opts, 3 - cfg.nb_channels, nullptr);
+}
+
+Result bench_downmix_simd(const Config& cfg, const Options& opts) {
+  return convert_frames("downmix_simd", cfg, opts, 3 - cfg.nb_channels, &sample_kernels());
+}
+
+// every int16 value on every channel, in odd-sized chunks so input is left pending
+std::vector<uint8_t> convert_all(Resampler& resampler, int nb_channels,
+                                 int out_channels, enum AVSampleFormat out_fmt) {
+  constexpr int nb_samples = 65536;
+  constexpr int chunk = 441;
+  std::vector<int16_t> in(static_cast<size_t>(nb_samples) * nb_channels);
+  for (int i = 0; i != nb_samples; ++i) {
+    for (int c = 0; c != nb_channels; ++c) {
+      in[static_cast<size_t>(i) * nb_channels + c] = static_cast<int16_t>(i * (c ? 7919 : 1) - 32768);
+    }
+  }
+
+  auto frame = make_frame(1024, out_channels, out_fmt);
+  int planes = av_sample_fmt_is_planar(out_fmt) ? out_channels : 1;
+  int plane_size = frame->nb_samples * (4 * out_channels / planes);
+  std::vector<uint8_t> out;
+  int filled = 0;
+  auto flush = [&](int nb) {
+    for (int p = 0; p != planes; ++p) {
+      out.insert(out.end(), frame->extended_data[p], frame->extended_data[p] + plane_size * nb / frame->nb_samples);
+    }
+  };
+
+  for (int i = 0; i < nb_samples; i += chunk) {
+    int in_samples = FFMIN(chunk, nb_samples - i);
+    const uint8_t* data[1] = {reinterpret_cast<const uint8_t*>(in.data() + static_cast<size_t>(i) * nb_channels)};
+    for (;;) {
+      int rc = resampler.resample(data, in_samples, frame.get(), filled);
+      if (rc < 0) {
+        throw std::runtime_error("bench: error converting");
+      }
+      in_samples = 0;
+      filled += rc;
+      if (filled < frame->nb_samples) {
+        break;
+      }
+      flush(filled);
+      filled = 0;
+    }
+  }
+  flush(filled);
+
+  return out;
+}
+
+// every kernel set this CPU supports against swr, bit for bit
+std::vector<Result> verify_kernels(const Config& cfg) {
+  std::vector<Result> results;
+  const std::pair<int, enum AVSampleFormat> outputs[] = {
+    {cfg.nb_channels, AV_SAMPLE_FMT_FLTP},
+    {cfg.nb_channels, AV_SAMPLE_FMT_FLT},
+    {3 - cfg.nb_channels, AV_SAMPLE_FMT_FLTP},
+    {3 - cfg.nb_channels, AV_SAMPLE_FMT_FLT},
+  };
+
+  for (const auto& [out_channels, out_fmt] : outputs) {
+    auto make_resampler = [&] {
+      return Resampler(cfg.sample_rate, ChannelLayoutHelper{cfg.nb_channels}.get(), AV_SAMPLE_FMT_S16,
+                       cfg.sample_rate, ChannelLayoutHelper{out_channels}.get(), out_fmt);
+    };
+    Resampler reference = make_resampler();
+    reference.set_kernels(nullptr);
+    auto expected = convert_all(reference, cfg.nb_channels, out_channels, out_fmt);
+
+    for (const SampleKernels* kernels : available_sample_kernels()) {
+      Resampler resampler = make_resampler();
+      resampler.set_kernels(kernels);
+      if (!resampler.kernels()) {
+        continue;  // no fast path for this conversion
+      }
+      auto actual = convert_all(resampler, cfg.nb_channels, out_channels, out_fmt);
+
+      int64_t mismatches = 0;
+      if (actual.size() != expected.size()) {
+        mismatches = static_cast<int64_t>(FFMAX(actual.size(), expected.size()) / 4);
+      } else {
+        for (size_t i = 0; i != actual.size(); i += 4) {
+          mismatches += memcmp(&actual[i], &expected[i], 4) != 0;
+        }
+      }
+
+      std::ostringstream config;
+      config << cfg.name << "_to_" << out_channels << "ch_" << av_get_sample_fmt_name(out_fmt)
+             << "_" << kernels->name;
+      Result r{"verify", config.str(), static_cast<int64_t>(expected.size() / 4), 0, -1};
+      r.mismatches = mismatches;
+      results.push_back(r);
+    }
+  }
+
+  return results;
+}
+
+// feeds one AAC frame per op to encode, only the encode call is timed
+template <typename Encode>
+Result encode_frames(const char* name, const Config& cfg, const Options& opts,
+                     Encoder& encoder, Encode&& encode) {
+  AVCodecContext* enc_ctx = encoder.ctx();
+  enc_ctx->time_base = av_make_q(1, cfg.sample_rate);
+  enc_ctx->sample_rate = cfg.sample_rate;
+  enc_ctx->sample_fmt = AV_SAMPLE_FMT_FLTP;
+  av_channel_layout_default(&enc_ctx->ch_layout, cfg.nb_channels);
+  if (encoder.open() < 0) {
+    throw std::runtime_error("bench: error opening encoder");
+  }
+
+  std::unique_ptr<AVFrame, decltype(&frame_deleter)> frame(av_frame_alloc(), &frame_deleter);
+  if (!frame) {
+    throw std::runtime_error("bench: Cannot allocate memory");
+  }
+  frame->nb_samples = enc_ctx->frame_size;
+  frame->format = enc_ctx->sample_fmt;
+  av_channel_layout_copy(&frame->ch_layout, &enc_ctx->ch_layout);
+  if (av_frame_get_buffer(frame.get(), 0) < 0) {
+    throw std::runtime_error("bench: error getting buffer");
+  }
+
+  int64_t iterations = static_cast<int64_t>(opts.seconds) * cfg.sample_rate / enc_ctx->frame_size;
+  double ns = 0.0;
+  for (int64_t i = 0; i != iterations; ++i) {
+    if (av_frame_make_writable(frame.get()) < 0) {
+      throw std::runtime_error("bench: error copying buffer");
+    }
+    for (int c = 0; c != cfg.nb_channels; ++c) {
+      float* plane = reinterpret_cast<float*>(frame->data[c]);
+      for (int n = 0; n != frame->nb_samples; ++n) {
+        plane[n] = static_cast<float>(sin(2.0 * M_PI * 950.0 * (i * frame->nb_samples + n) / cfg.sample_rate) * 0.5);
+      }
+    }
+    frame->pts = i * frame->nb_samples;
+
+    auto start = clock_type::now();
+    if (encode(frame.get()) < 0) {
+      throw std::runtime_error("bench: error encoding");
+    }
+    ns += elapsed_ns(start);
+  }
+
+  return {name, cfg.name, iterations, ns / iterations, iterations * frame->nb_samples / (ns * 1e-9)};
+}
+
+// EncodeHelper::encode, packets through std::function
+Result bench_encode(const Config& cfg, const Options& opts) {
+  int64_t nb_packets = 0;
+  EncodeHelper helper(AV_CODEC_ID_AAC, [&nb_packets](AVPacket*) { ++nb_packets; });
+  return encode_frames("encode", cfg, opts, helper.encoder_,
+                       [&helper](const AVFrame* frame) { return helper.encode(frame); });
+}
+
+// EncodeStage, packets to an inlined sink
+Result bench_encode_stage(const Config& cfg, const Options& opts) {
+  int64_t nb_packets = 0;
+  Encoder encoder(AV_CODEC_ID_AAC);
+  EncodeStage stage(encoder, [&nb_packets](AVPacket*) { ++nb_packets; });
+  return encode_frames("encode_stage", cfg, opts, encoder, stage);
+}
+
+// av_streamer_write_audio into a file muxer, capture-sized chunks
+Result bench_streamer(const Config& cfg, const Options& opts) {
+  int chunk = cfg.sample_rate * opts.chunk_ms / 1000;
+  int64_t iterations = static_cast<int64_t>(opts.seconds) * 1000 / opts.chunk_ms;
+  auto tone = make_tone(cfg, chunk);
+
+  av_streamer_opts_t streamer_opts;
+  av_streamer_opts_default(&streamer_opts);
+  streamer_opts.sample_rate = cfg.sample_rate;
+  streamer_opts.nb_channels = cfg.nb_channels;
+  streamer_opts.url = opts.output;
+
+  std::unique_ptr<av_streamer_t, decltype(&av_streamer_free)>
+      streamer(av_streamer_alloc2(&streamer_opts), &av_streamer_free);
+  if (!streamer) {
+    throw std::runtime_error("bench: error allocating av_streamer");
+  }
+
+  // the pool is warm after the first second, it must not allocate after that
+  int64_t warm_iterations = std::min<int64_t>(iterations, 1000 / opts.chunk_ms);
+  av_streamer_stats_t warm_stats{};
+  av_streamer_stats_t stats;
+
+  auto start = clock_type::now();
+  for (int64_t i = 0; i != iterations; ++i) {
+    if (i == warm_iterations && av_streamer_get_stats(streamer.get(), &warm_stats) < 0) {
+      throw std::runtime_error("bench: error getting stats");
+    }
+    if (av_streamer_write_audio(streamer.get(),
+                                reinterpret_cast<const unsigned char*>(tone.data()),
+                                chunk) < 0) {
+      throw std::runtime_error("bench: error writing audio");
+    }
+  }
+  double ns = elapsed_ns(start);
+
+  if (av_streamer_get_stats(streamer.get(), &stats) < 0) {
+    throw std::runtime_error("bench: error getting stats");
+  }
+
+  Result r{"streamer_write_audio", cfg.name, iterations, ns / iterations, iterations * chunk / (ns * 1e-9),
+           static_cast<int64_t>(stats.frame_allocs)};
+  if (warm_iterations < iterations) {
+    r.frame_alloc_growth = static_cast<int64_t>(stats.frame_allocs - warm_stats.frame_allocs);
+  }
+  return r;
+}
+
+// resident set size from /proc, Linux only
+int64_t resident_bytes() {
+  FILE* fp = fopen("/proc/self/statm", "r");
+  long pages = 0;
+  long resident = -1;
+  if (fp) {
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+      resident = -1;
+    }
+    fclose(fp);
+  }
+  if (resident < 0) {
+    throw std::runtime_error("bench: error reading /proc/self/statm");
+  }
+  return static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+// RSS growth per live streamer, each fed one second of audio first so its
+// buffers and pools have reached steady state
+Result session_rss(const char* name, const Config& cfg, const Options& opts, bool async) {
+  using streamer_ptr = std::unique_ptr<av_streamer_t, decltype(&av_streamer_free)>;
+  int chunk = cfg.sample_rate * opts.chunk_ms / 1000;
+  auto tone = make_tone(cfg, chunk);
+
+  av_streamer_opts_t streamer_opts;
+  av_streamer_opts_default(&streamer_opts);
+  streamer_opts.sample_rate = cfg.sample_rate;
+  streamer_opts.nb_channels = cfg.nb_channels;
+  streamer_opts.url = opts.output;
+  streamer_opts.async = async;
+
+  auto open_session = [&] {
+    streamer_ptr streamer(av_streamer_alloc2(&streamer_opts), &av_streamer_free);
+    if (!streamer) {
+      throw std::runtime_error("bench: error allocating av_streamer");
+    }
+    for (int i = 0; i != 1000 / opts.chunk_ms; ++i) {
+      if (av_streamer_write_audio(streamer.get(),
+                                  reinterpret_cast<const unsigned char*>(tone.data()),
+                                  chunk) < 0) {
+        throw std::runtime_error("bench: error writing audio");
+      }
+    }
+    return streamer;
+  };
+
+  // codec tables and other one-off state are loaded by the first session
+  open_session().reset();
+
+  std::vector<streamer_ptr> streamers;
+  streamers.reserve(opts.sessions);
+  int64_t before = resident_bytes();
+  auto start = clock_type::now();
+  for (int i = 0; i != opts.sessions; ++i) {
+    streamers.push_back(open_session());
+  }
+  double ns = elapsed_ns(start);
+  if (async) {
+    // let the workers drain the rings
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  int64_t after = resident_bytes();
+
+  Result r{name, cfg.name, opts.sessions, ns / opts.sessions, -1};
+  r.rss_per_session = static_cast<double>(after - before) / opts.sessions;
+  return r;
+}
+
+Result bench_session_rss(const Config& cfg, const Options& opts) {
+  return session_rss("session_rss", cfg, opts, false);
+}
+
+Result bench_session_rss_async(const Config& cfg, const Options& opts) {
+  return session_rss("session_rss_async", cfg, opts, true);
+}
+
+// Demuxer::read_frame until EOF, one packet per op
+Result demux_file(const char* name, const char* path, AVIOMmapReader* mmap_reader) {
+  Demuxer demuxer;
+  if (mmap_reader) {
+    demuxer.set_avio(mmap_reader->ctx());
+  }
+  if (demuxer.open(path) < 0) {
+    throw std::runtime_error("bench: error opening input");
+  }
+
+  std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt(av_packet_alloc(), &pkt_deleter);
+  if (!pkt) {
+    throw std::runtime_error("bench: Cannot allocate memory");
+  }
+
+  int64_t packets = 0;
+  int64_t bytes = 0;
+  auto start = clock_type::now();
+  while (demuxer.read_frame(pkt.get()) >= 0) {
+    ++packets;
+    bytes += pkt->size;
+    av_packet_unref(pkt.get());
+  }
+  double ns = elapsed_ns(start);
+
+  if (!packets) {
+    throw std::runtime_error("bench: no packets demuxed");
+  }
+
+  Result r{name, "input", packets, ns / packets, -1};
+  r.bytes_per_sec = bytes / (ns * 1e-9);
+  return r;
+}
+
+// default file protocol, buffered read(2) into the AVIO buffer
+Result bench_demux_file(const Options& opts) {
+  return demux_file("demux_file", opts.input, nullptr);
+}
+
+// AVIOMmapReader, memcpy from the mapping into the AVIO buffer
+Result bench_demux_mmap(const Options& opts) {
+  AVIOMmapReader reader(opts.input);
+  return demux_file("demux_mmap", opts.input, &reader);
+}
+
+// peak amplitude of a decoded frame, 0..1
+double frame_peak(const AVFrame* frame) {
+  auto fmt = static_cast<enum AVSampleFormat>(frame->format);
+  bool planar = av_sample_fmt_is_planar(fmt);
+  int planes = planar ? frame->ch_layout.nb_channels : 1;
+  int n = planar ? frame->nb_samples : frame->nb_samples * frame->ch_layout.nb_channels;
+  double peak = 0.0;
+
+  for (int p = 0; p != planes; ++p) {
+    for (int i = 0; i != n; ++i) {
+      switch (fmt) {
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_FLTP:
+          peak = std::max(peak, std::fabs(static_cast<double>(reinterpret_cast<const float*>(frame->extended_data[p])[i])));
+          break;
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+          peak = std::max(peak, std::abs(reinterpret_cast<const int16_t*>(frame->extended_data[p])[i]) / 32768.0);
+          break;
+        default:
+          throw std::runtime_error("bench: unsupported sample format");
+      }
+    }
+  }
+
+  return peak;
+}
+
+// Listens for one FLV connection, decodes the audio and records when each
+// tone burst starts to come out of the decoder.
+void latency_sink(const std::string& url, std::vector<clock_type::time_point>& onsets,
+                  std::mutex& mtx, std::string& error) {
+  try {
+    Demuxer demuxer;
+    if (demuxer.open(url.c_str(), av_find_input_format("flv")) < 0) {
+      throw std::runtime_error("bench: error opening sink");
+    }
+
+    std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt(av_packet_alloc(), &pkt_deleter);
+    if (!pkt) {
+      throw std::runtime_error("bench: Cannot allocate memory");
+    }
+
+    bool in_burst = false;
+    std::unique_ptr<DecodeHelper> decoder;
+    while (demuxer.read_frame(pkt.get()) >= 0) {
+      const AVStream* st = demuxer.ctx()->streams[pkt->stream_index];
+      if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+        if (!decoder) {
+          decoder = std::make_unique<DecodeHelper>(st, [&](AVFrame* frame) {
+            double peak = frame_peak(frame);
+            if (!in_burst && peak > 0.1) {
+              std::lock_guard<std::mutex> lk(mtx);
+              onsets.push_back(clock_type::now());
+              in_burst = true;
+            } else if (in_burst && peak < 0.02) {
+              in_burst = false;
+            }
+          }, 1);
+        }
+        decoder->decode(pkt.get());
+      }
+      av_packet_unref(pkt.get());
+    }
+  } catch (const std::exception& e) {
+    std::lock_guard<std::mutex> lk(mtx);
+    error = e.what();
+  }
+}
+
+// Glass-to-glass latency: writes in real time, a 100 ms tone burst every
+// 500 ms, into an av_streamer publishing to a local sink. Latency is from
+// handing the burst to av_streamer_write_audio to its onset at the decoder.
+Result measure_latency(const char* name, const Config& cfg, const Options& opts, bool low_latency) {
+  static constexpr int period_ms = 500;
+  static constexpr int burst_ms = 100;
+
+  std::string url = "tcp://127.0.0.1:" + std::to_string(opts.latency_port);
+  std::vector<clock_type::time_point> bursts;
+  std::vector<clock_type::time_point> onsets;
+  std::mutex mtx;
+  std::string error;
+  std::thread sink(latency_sink, url + "?listen=1", std::ref(onsets), std::ref(mtx), std::ref(error));
+
+  av_streamer_opts_t streamer_opts;
+  av_streamer_opts_default(&streamer_opts);
+  streamer_opts.sample_rate = cfg.sample_rate;
+  streamer_opts.nb_channels = cfg.nb_channels;
+  streamer_opts.url = url.c_str();
+  streamer_opts.low_latency = low_latency;
+
+  // the sink may not be listening yet
+  std::unique_ptr<av_streamer_t, decltype(&av_streamer_free)> streamer(nullptr, &av_streamer_free);
+  for (int i = 0; i != 100 && !streamer; ++i) {
+    streamer.reset(av_streamer_alloc2(&streamer_opts));
+    if (!streamer) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+  if (!streamer) {
+    sink.detach();
+    throw std::runtime_error("bench: error connecting to sink");
+  }
+
+  int chunk = cfg.sample_rate * opts.chunk_ms / 1000;
+  auto tone = make_tone(cfg, chunk);
+  std::vector<int16_t> silence(tone.size(), 0);
+  // one more period of silence flushes the last burst through the encoder
+  int64_t nb_chunks = (static_cast<int64_t>(opts.seconds) * 1000 + period_ms) / opts.chunk_ms;
+  int64_t nb_burst_chunks = static_cast<int64_t>(opts.seconds) * 1000 / opts.chunk_ms;
+
+  auto start = clock_type::now();
+  bool ok = true;
+  for (int64_t i = 0; ok && i != nb_chunks; ++i) {
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(i * opts.chunk_ms));
+
+    int64_t t_ms = i * opts.chunk_ms % period_ms;
+    bool burst = i < nb_burst_chunks && t_ms < burst_ms;
+    if (burst && !t_ms) {
+      bursts.push_back(clock_type::now());
+    }
+    const int16_t* data = burst ? tone.data() : silence.data();
+    ok = av_streamer_write_audio(streamer.get(), reinterpret_cast<const unsigned char*>(data), chunk) >= 0;
+  }
+  // closing the connection ends the sink
+  streamer.reset();
+  sink.join();
+
+  if (!ok) {
+    throw std::runtime_error("bench: error writing audio");
+  }
+
+  if (!error.empty()) {
+    throw std::runtime_error(error);
+  }
+
+  size_t n = std::min(bursts.size(), onsets.size());
+  if (!n) {
+    throw std::runtime_error("bench: no burst detected at the sink");
+  }
+
+  double total_ns = 0.0;
+  double max_ns = 0.0;
+  for (size_t i = 0; i != n; ++i) {
+    double ns = std::chrono::duration<double, std::nano>(onsets[i] - bursts[i]).count();
+    total_ns += ns;
+    max_ns = std::max(max_ns, ns);
+  }
+
+  Result r{name, cfg.name, static_cast<int64_t>(n), total_ns / n, -1};
+  r.max_ns = max_ns;
+  return r;
+}
+
+Result bench_latency(const Config& cfg, const Options& opts) {
+  return measure_latency("latency", cfg, opts, false);
+}
+
+Result bench_latency_low(const Config& cfg, const Options& opts) {
+  return measure_latency("latency_low", cfg, opts, true);
+}
+
+// audio may end this far from video: the last partial frame and AAC priming
+constexpr double max_av_drift = 0.25;
+
+// Async streamer with video, where every burst of audio is bigger than the
+// ring and is dropped. Dropped samples must still move the audio timeline,
+// or audio ends early by every burst against the caller-timed video.
+Result bench_ring_overflow(const Config& cfg, const Options& opts) {
+  static constexpr int width = 64;
+  static constexpr int height = 64;
+  static constexpr int frame_ms = 40;
+  static constexpr int ring_ms = 100;
+  static constexpr int burst_ms = 150;  // never fits the ring
+  static constexpr int burst_every_ms = 500;
+
+  char path[] = "/tmp/av-tools-ring-XXXXXX.flv";
+  int fd = mkstemps(path, 4);
+  if (fd < 0) {
+    throw std::runtime_error("bench: error creating temp file");
+  }
+  close(fd);
+
+  int chunk = cfg.sample_rate * opts.chunk_ms / 1000;
+  int burst_samples = cfg.sample_rate * burst_ms / 1000;
+  auto tone = make_tone(cfg, chunk);
+  auto burst = make_tone(cfg, burst_samples);
+  std::vector<unsigned char> luma(width * height, 128);
+  std::vector<unsigned char> chroma(width * height / 4, 128);
+  const unsigned char* const planes[3] = {luma.data(), chroma.data(), chroma.data()};
+  const int strides[3] = {width, width / 2, width / 2};
+
+  av_streamer_opts_t streamer_opts;
+  av_streamer_opts_default(&streamer_opts);
+  streamer_opts.sample_rate = cfg.sample_rate;
+  streamer_opts.nb_channels = cfg.nb_channels;
+  streamer_opts.url = path;
+  streamer_opts.async = 1;
+  streamer_opts.async_buffer_ms = ring_ms;
+  streamer_opts.width = width;
+  streamer_opts.height = height;
+  streamer_opts.frame_rate = 1000 / frame_ms;
+
+  int64_t total_ms = static_cast<int64_t>(opts.seconds) * 1000;
+  int64_t ms = 0;
+  int64_t next_video_ms = 0;
+  int64_t next_burst_ms = burst_every_ms;
+  int64_t iterations = 0;
+  double ns = 0.0;
+  av_streamer_stats_t stats;
+
+  try {
+    std::unique_ptr<av_streamer_t, decltype(&av_streamer_free)>
+        streamer(av_streamer_alloc2(&streamer_opts), &av_streamer_free);
+    if (!streamer) {
+      throw std::runtime_error("bench: error allocating av_streamer");
+    }
+
+    auto start = clock_type::now();
+    while (ms < total_ms) {
+      if (ms >= next_video_ms) {
+        if (av_streamer_write_video(streamer.get(), planes, strides, next_video_ms) < 0) {
+          throw std::runtime_error("bench: error writing video");
+        }
+        next_video_ms += frame_ms;
+      }
+      if (ms >= next_burst_ms) {
+        if (av_streamer_write_audio(streamer.get(),
+                                    reinterpret_cast<const unsigned char*>(burst.data()),
+                                    burst_samples) < 0) {
+          throw std::runtime_error("bench: error writing audio");
+        }
+        ms += burst_ms;
+        next_burst_ms += burst_every_ms;
+      } else {
+        if (av_streamer_write_audio(streamer.get(),
+                                    reinterpret_cast<const unsigned char*>(tone.data()),
+                                    chunk) < 0) {
+          throw std::runtime_error("bench: error writing audio");
+        }
+        ms += opts.chunk_ms;
+      }
+      ++iterations;
+    }
+    ns = elapsed_ns(start);
+
+    // Let the worker catch up, then close both tracks at the same time. The
+    // closing audio chunk also records samples dropped at the end.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    if (av_streamer_write_audio(streamer.get(),
+                                reinterpret_cast<const unsigned char*>(tone.data()),
+                                chunk) != 0) {
+      throw std::runtime_error("bench: error writing audio");
+    }
+    ms += opts.chunk_ms;
+    if (av_streamer_write_video(streamer.get(), planes, strides, ms) < 0) {
+      throw std::runtime_error("bench: error writing video");
+    }
+    if (av_streamer_get_stats(streamer.get(), &stats) < 0) {
+      throw std::runtime_error("bench: error getting stats");
+    }
+    if (!stats.dropped_samples) {
+      throw std::runtime_error("bench: ring did not overflow");
+    }
+  } catch (...) {
+    unlink(path);
+    throw;
+  }
+
+  // freed, so the file is complete; compare where each track ends
+  double audio_end = 0.0;
+  double video_end = 0.0;
+  {
+    Demuxer demuxer;
+    std::unique_ptr<AVPacket, decltype(&pkt_deleter)> pkt(av_packet_alloc(), &pkt_deleter);
+    if (!pkt || demuxer.open(path) < 0) {
+      unlink(path);
+      throw std::runtime_error("bench: error opening ring_overflow output");
+    }
+    while (demuxer.read_frame(pkt.get()) >= 0) {
+      const AVStream* st = demuxer.ctx()->streams[pkt->stream_index];
+      if (pkt->pts != AV_NOPTS_VALUE) {
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+          audio_end = std::max(audio_end, (pkt->pts + pkt->duration) * av_q2d(st->time_base));
+        } else {
+          video_end = std::max(video_end, pkt->pts * av_q2d(st->time_base));
+        }
+      }
+      av_packet_unref(pkt.get());
+    }
+  }
+  unlink(path);
+
+  Result r{"ring_overflow", cfg.name, iterations, ns / iterations, -1};
+  r.av_drift = std::abs(audio_end - video_end);
+  return r;
+}
+
+void print_json(const std::vector<Result>& results, const Options& opts) {
+  std::ostringstream os;
+  os << "{\n"
+     << "  \"seconds\": " << opts.seconds << ",\n"
+     << "  \"chunk_ms\": " << opts.chunk_ms << ",\n"
+     << "  \"results\": [\n";
+  for (size_t i = 0; i != results.size(); ++i) {
+    const auto& r = results[i];
+    os << "    {\"name\": \"" << r.name << "\""
+       << ", \"config\": \"" << r.config << "\""
+       << ", \"iterations\": " << r.iterations
+       << ", \"ns_per_op\": " << r.ns_per_op;
+    if (r.samples_per_sec >= 0) {
+      os << ", \"samples_per_sec\": " << r.samples_per_sec;
+    }
+    if (r.bytes_per_sec >= 0) {
+      os << ", \"bytes_per_sec\": " << r.bytes_per_sec;
+    }
+    if (r.max_ns >= 0) {
+      os << ", \"max_ns\": " << r.max_ns;
+    }
+    if (r.frame_allocs >= 0) {
+      os << ", \"frame_allocs\": " << r.frame_allocs;
+    }
+    if (r.frame_alloc_growth >= 0) {
+      os << ", \"frame_alloc_growth\": " << r.frame_alloc_growth;
+    }
+    if (r.rss_per_session >= 0) {
+      os << ", \"rss_per_session\": " << r.rss_per_session;
+    }
+    if (r.mismatches >= 0) {
+      os << ", \"mismatches\": " << r.mismatches;
+    }
+    if (r.av_drift >= 0) {
+      os << ", \"av_drift\": " << r.av_drift;
+    }
+    os << "}" << (i + 1 != results.size() ? ",\n" : "\n");
+  }
+  os << "  ]\n"
+     << "}\n";
+  cout << os.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  std::vector<std::string> filters;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      opts.seconds = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--chunk-ms") && i + 1 < argc) {
+      opts.chunk_ms = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+      opts.output = argv[++i];
+    } else if (!strcmp(argv[i], "--input") && i + 1 < argc) {
+      opts.input = argv[++i];
+    } else if (!strcmp(argv[i], "--latency-port") && i + 1 < argc) {
+      opts.latency_port = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--sessions") && i + 1 < argc) {
+      opts.sessions = atoi(argv[++i]);
+    } else if (argv[i][0] != '-') {
+      filters.emplace_back(argv[i]);
+    } else {
+      cerr << "Usage: ./av-tools-bench [--seconds N] [--chunk-ms N] [--output url] [--input file] [--latency-port N] [--sessions N] [bench...]\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (opts.seconds <= 0 || opts.chunk_ms <= 0 || opts.sessions <= 0) {
+    cerr << "invalid --seconds, --chunk-ms or --sessions\n";
+    exit(EXIT_FAILURE);
+  }
+
+  const std::pair<const char*, std::function<Result(const Config&, const Options&)>> benches[] = {
+    {"resample", bench_resample},
+    {"resample_direct", bench_resample_direct},
+    {"encode", bench_encode},
+    {"encode_stage", bench_encode_stage},
+    {"streamer_write_audio", bench_streamer},
+    {"convert_swr", bench_convert_swr},
+    {"convert_simd", bench_convert_simd},
+    {"downmix_swr", bench_downmix_swr},
+    {"downmix_simd", bench_downmix_simd},
+    {"session_rss", bench_session_rss},
+    {"session_rss_async", bench_session_rss_async},
+  };
+
+  // real time, or a check rather than a measurement, so only when asked for by name
+  const std::pair<const char*, std::function<Result(const Config&, const Options&)>> realtime_benches[] = {
+    {"latency", bench_latency},
+    {"latency_low", bench_latency_low},
+    {"ring_overflow", bench_ring_overflow},
+  };
+
+  // per input file rather than per audio config, only with --input
+  const std::pair<const char*, std::function<Result(const Options&)>> input_benches[] = {
+    {"demux_file", bench_demux_file},
+    {"demux_mmap", bench_demux_mmap},
+  };
+
+  auto selected = [&filters](const char* name) {
+    return filters.empty() || std::find(filters.begin(), filters.end(), name) != filters.end();
+  };
+
+  std::vector<Result> results;
+  try {
+    for (const auto& [name, fn] : benches) {
+      if (!selected(name)) {
+        continue;
+      }
+      for (const auto& cfg : configs) {
+        results.push_back(fn(cfg, opts));
+      }
+    }
+
+    for (const auto& [name, fn] : realtime_benches) {
+      if (filters.empty() || !selected(name)) {
+        continue;
+      }
+      for (const auto& cfg : configs) {
+        results.push_back(fn(cfg, opts));
+      }
+    }
+
+    if (selected("verify")) {
+      for (const auto& cfg : configs) {
+        auto verified = verify_kernels(cfg);
+        results.insert(results.end(), verified.begin(), verified.end());
+      }
+    }
+
+    if (opts.input) {
+      // untimed pass so both variants read from a warm page cache
+      demux_file("warmup", opts.input, nullptr);
+      for (const auto& [name, fn] : input_benches) {
+        if (selected(name)) {
+          results.push_back(fn(opts));
+        }
+      }
+    }
+  } catch (const std::exception& e) {
+    cerr << e.what() << "\n";
+    exit(EXIT_FAILURE);
+  }
+
+  print_json(results, opts);
+
+  // kernel mismatches, frame buffers still being allocated once warm, or
+  // audio drifting from video after ring overflows
+  bool ok = std::all_of(results.begin(), results.end(), [](const Result& r) {
+    return r.mismatches <= 0 && r.frame_alloc_growth <= 0 && r.av_drift <= max_av_drift;
+  });
+
+  return ok ? 0 : EXIT_FAILURE;
+}